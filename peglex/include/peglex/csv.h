@@ -0,0 +1,247 @@
+// (c) James Gregson 2024, MIT license
+#pragma once
+
+#include <peglex/peglex.h>
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace peglex::csv {
+
+    /**
+     * @brief Event handler, fields are passed as zero-copy views of the source
+     * Quoted fields exclude the enclosing quotes but keep doubled quotes, use csv::unescape() if needed.
+     */
+    template< typename H >
+    concept Handler = requires( H& h, std::string_view s, bool quoted ){
+        h.field( s, quoted );
+        h.end_record();
+    };
+
+    /**
+     * @brief Handler that ignores every event, used for validate-only parsing
+     */
+    struct NullHandler {
+        void field( std::string_view, bool ){}
+        void end_record(){}
+    };
+
+    inline NullHandler null_handler;
+
+    namespace detail {
+        // returns one past the end of a quoted field starting after its opening quote, or nullptr
+        inline const char* scan_quoted( const char* src ){
+            while( (src = std::strchr( src, '"' )) ){
+                if( src[1] != '"' ){
+                    return src+1;
+                }
+                src += 2;
+            }
+            return nullptr;
+        }
+
+        // counts quotes with memchr so that the scan runs at memory bandwidth
+        inline size_t count_quotes( const char* begin, const char* end ){
+            size_t count = 0;
+            while( begin < end && (begin = static_cast<const char*>(std::memchr( begin, '"', end-begin ))) ){
+                ++count;
+                ++begin;
+            }
+            return count;
+        }
+    }
+
+    /**
+     * @brief Record, matches one RFC 4180 record including its CRLF or LF terminator
+     * The final record of the input may omit the terminator. Quoted fields may contain
+     * delimiters, doubled quotes and line breaks; quotes inside unquoted fields fail the match.
+     */
+    template< Handler H >
+    struct Record : public Pattern {
+        Record( H& handler, char delim=',' ) : _handler{handler}, _stops{delim,'"','\r','\n','\0'} {}
+        std::optional<const char*> match( const char* src ) const override {
+            if( !src || !*src ){
+                return std::nullopt;
+            }
+            while( true ){
+                if( *src == '"' ){
+                    const char* end = detail::scan_quoted( src+1 );
+                    if( !end ){
+                        return std::nullopt;
+                    }
+                    _handler.field( std::string_view( src+1, end-src-2 ), true );
+                    src = end;
+                } else {
+                    // strcspn over a short stop set is vectorized in common C libraries, padded
+                    // buffers use the dispatched kernels which include the terminator in the set
+                    const size_t n = peglex::detail::padded( src )
+                                   ? simd::find_any( src, peglex::detail::padded_end+PaddedBuffer::padding, {_stops,5} ) - src
+                                   : std::strcspn( src, _stops );
+                    if( src[n] == '"' ){
+                        return std::nullopt;
+                    }
+                    _handler.field( std::string_view( src, n ), false );
+                    src += n;
+                }
+
+                if( *src == _stops[0] ){
+                    ++src;
+                    continue;
+                }
+                if( *src == '\r' && src[1] == '\n' ){
+                    _handler.end_record();
+                    return src+2;
+                }
+                if( *src == '\n' ){
+                    _handler.end_record();
+                    return src+1;
+                }
+                if( *src == '\0' ){
+                    _handler.end_record();
+                    return src;
+                }
+                return std::nullopt;
+            }
+        }
+        H&   _handler;
+        char _stops[5];
+    };
+
+    template< Handler H >
+    Record<H> record( H& handler, char delim=',' ){
+        return Record<H>( handler, delim );
+    }
+
+    template< Handler H >
+    Record<NullHandler> validator_of( const Record<H>& e ){
+        return Record<NullHandler>( null_handler, e._stops[0] );
+    }
+
+    // an entire CSV text, header rows are reported like any other record
+    template< Handler H >
+    auto document( H& handler, char delim=',' ){
+        return star( record( handler, delim ) ) & eof();
+    }
+
+    /**
+     * @brief Splits [begin,end) into about n chunks that each start at a record boundary
+     * Returns n+1 boundaries at most (fewer if chunks collapse), the first being begin and the last end.
+     * Quote state at each nominal split point follows from the parity of the quotes before it,
+     * since quotes inside quoted fields are doubled. The per-chunk quote counts are independent
+     * and the input must be well formed for the boundaries to be exact.
+     */
+    inline std::vector<const char*> split( const char* begin, const char* end, size_t n ){
+        std::vector<const char*> bounds{ begin };
+        const size_t size = end-begin;
+        n = std::max<size_t>( n, 1 );
+
+        bool in_quotes = false;
+        const char* prev = begin;
+        for( size_t i=1; i<n; ++i ){
+            const char* nominal = begin + size*i/n;
+            if( nominal <= bounds.back() ){
+                continue;
+            }
+            in_quotes ^= detail::count_quotes( prev, nominal ) & 1;
+            prev = nominal;
+
+            // advance to the first line feed outside quotes
+            bool state = in_quotes;
+            const char* p = nominal;
+            while( p < end && (state || *p != '\n') ){
+                state ^= (*p == '"');
+                ++p;
+            }
+            if( p >= end ){
+                break;
+            }
+            bounds.push_back( p+1 );
+        }
+        if( bounds.back() != end ){
+            bounds.push_back( end );
+        }
+        return bounds;
+    }
+
+    /**
+     * @brief As split(begin,end,n) over a whole buffer, with quotes and line feeds taken from a StructuralIndex
+     * The index must declare both '"' and '\n' structural; quote parity is then a popcount per
+     * chunk and the search for the next record start skips directly between structural positions.
+     */
+    inline std::vector<const char*> split( const StructuralIndex& index, size_t n ){
+        const char* begin = index.buffer().data();
+        const char* end   = begin+index.buffer().size();
+        if( !index.indexed('"') || !index.indexed('\n') ){
+            return split( begin, end, n );
+        }
+        std::vector<const char*> bounds{ begin };
+        const size_t size = end-begin;
+        n = std::max<size_t>( n, 1 );
+
+        bool in_quotes = false;
+        const char* prev = begin;
+        for( size_t i=1; i<n; ++i ){
+            const char* nominal = begin + size*i/n;
+            if( nominal <= bounds.back() ){
+                continue;
+            }
+            in_quotes ^= index.count( prev, nominal, '"' ) & 1;
+            prev = nominal;
+
+            // hop between quotes until a line feed comes first outside quotes
+            bool state = in_quotes;
+            const char* p = nominal;
+            while( p < end ){
+                const char* quote = index.find( p, '"' );
+                const char* lf    = index.find( p, '\n' );
+                if( !state && lf < quote ){
+                    p = lf;
+                    break;
+                }
+                if( quote >= end || *quote != '"' ){
+                    p = end;
+                    break;
+                }
+                state = !state;
+                p = quote+1;
+            }
+            if( p >= end ){
+                break;
+            }
+            bounds.push_back( p+1 );
+        }
+        if( bounds.back() != end ){
+            bounds.push_back( end );
+        }
+        return bounds;
+    }
+
+    /**
+     * @brief Parses the records of a chunk produced by split(), chunks may be parsed concurrently
+     * The source buffer must be NUL terminated at its end so that the final record can omit its terminator.
+     */
+    template< Handler H >
+    bool parse_chunk( const char* begin, const char* end, H& handler, char delim=',' ){
+        auto rec = record( handler, delim );
+        while( begin < end ){
+            auto ret = rec.match( begin );
+            if( !ret || *ret == begin ){
+                return false;
+            }
+            begin = *ret;
+        }
+        return begin == end;
+    }
+
+    // collapses the doubled quotes of a quoted field view, appending to out
+    inline void unescape( std::string_view raw, std::string& out ){
+        for( size_t i=0; i<raw.size(); ++i ){
+            out += raw[i];
+            if( raw[i] == '"' ){
+                ++i;
+            }
+        }
+    }
+};
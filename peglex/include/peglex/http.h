@@ -0,0 +1,324 @@
+// (c) James Gregson 2024, MIT license
+#pragma once
+
+#include <peglex/peglex.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace peglex::http {
+
+    /**
+     * @brief Result of an incremental parse, Incomplete asks the caller to retry with more data
+     */
+    enum class Status { Complete, Incomplete, Error };
+
+    struct Result {
+        Status status;
+        size_t consumed = 0;
+    };
+
+    /**
+     * @brief Header, zero-copy views of a field name and its value without surrounding whitespace
+     */
+    struct Header {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    // folds only 'A'-'Z', so that e.g. '@' and '`' or '^' and '~' still differ
+    inline char tolower_ascii( char c ){
+        return c >= 'A' && c <= 'Z' ? char(c | 0x20) : c;
+    }
+
+    inline bool iequals( std::string_view a, std::string_view b ){
+        if( a.size() != b.size() ){
+            return false;
+        }
+        for( size_t i=0; i<a.size(); ++i ){
+            if( tolower_ascii(a[i]) != tolower_ascii(b[i]) ){
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Request, request line and headers as views into the parsed buffer
+     * Headers beyond max_headers fail the parse, as in picohttpparser.
+     */
+    struct Request {
+        static constexpr size_t max_headers = 64;
+
+        // case-insensitive lookup of the first header with the given name
+        const Header* header( std::string_view name ) const {
+            for( size_t i=0; i<num_headers; ++i ){
+                if( iequals( headers[i].name, name ) ){
+                    return &headers[i];
+                }
+            }
+            return nullptr;
+        }
+
+        std::string_view method;
+        std::string_view target;
+        int              version_major = 0;
+        int              version_minor = 0;
+        std::array<Header,max_headers> headers;
+        size_t           num_headers = 0;
+    };
+
+    namespace detail {
+        // RFC 9110 token characters
+        inline bool is_tchar( char c ){
+            static constexpr auto table = []{
+                std::array<bool,256> t{};
+                for( int c='0'; c<='9'; ++c ) t[c] = true;
+                for( int c='a'; c<='z'; ++c ) t[c] = true;
+                for( int c='A'; c<='Z'; ++c ) t[c] = true;
+                for( char c : std::string_view("!#$%&'*+-.^_`|~") ) t[static_cast<unsigned char>(c)] = true;
+                return t;
+            }();
+            return table[static_cast<unsigned char>(c)];
+        }
+
+        // visible characters, spaces, tabs and obs-text allowed in field values
+        inline bool is_field_char( char c ){
+            const unsigned char u = static_cast<unsigned char>(c);
+            return u >= 0x20 ? u != 0x7f : u == '\t';
+        }
+
+        inline bool is_target_char( char c ){
+            const unsigned char u = static_cast<unsigned char>(c);
+            return u > 0x20 && u != 0x7f;
+        }
+
+        /**
+         * @brief Scan, matches one or more characters accepted by a predicate
+         */
+        template< bool (*Pred)(char) >
+        struct Scan : public Pattern {
+            std::optional<const char*> match( const char* src ) const override {
+                const char* start = src;
+                while( src && Pred(*src) ){
+                    ++src;
+                }
+                if( src && src != start ){
+                    return src;
+                }
+                return std::nullopt;
+            }
+        };
+
+        /**
+         * @brief HeaderField, matches `name ":" OWS value OWS` and appends it to a request
+         */
+        struct HeaderField : public Pattern {
+            HeaderField( Request& req ) : _req{req} {}
+            std::optional<const char*> match( const char* src ) const override {
+                const char* name = src;
+                while( is_tchar(*src) ){
+                    ++src;
+                }
+                if( src == name || *src != ':' || _req.num_headers == Request::max_headers ){
+                    return std::nullopt;
+                }
+                Header& h = _req.headers[_req.num_headers];
+                h.name = std::string_view( name, src-name );
+                ++src;
+                while( *src == ' ' || *src == '\t' ){
+                    ++src;
+                }
+                const char* value = src;
+                while( is_field_char(*src) ){
+                    ++src;
+                }
+                const char* end = src;
+                while( end > value && (end[-1] == ' ' || end[-1] == '\t') ){
+                    --end;
+                }
+                h.value = std::string_view( value, end-value );
+                ++_req.num_headers;
+                return src;
+            }
+            Request& _req;
+        };
+
+        inline auto eol(){ return ( Char('\r') & '\n' ) | newline(); }
+
+        // end of the header block, accepting bare LF line endings like most servers
+        inline const char* find_blank_line( const char* begin, const char* end ){
+            for( const char* p = begin; p < end && (p = static_cast<const char*>(std::memchr( p, '\n', end-p ))); ++p ){
+                if( p+1 < end && p[1] == '\n' ){
+                    return p+2;
+                }
+                if( p+2 < end && p[1] == '\r' && p[2] == '\n' ){
+                    return p+3;
+                }
+            }
+            return nullptr;
+        }
+    }
+
+    // request-line CRLF *( field-line CRLF ) CRLF, filling req
+    inline auto request( Request& req ){
+        auto [method,target,major,minor] = fields<&Request::method,&Request::target,&Request::version_major,&Request::version_minor>(req);
+        auto request_line = method( detail::Scan<detail::is_tchar>() ) & ' '
+                          & target( detail::Scan<detail::is_target_char>() ) & ' '
+                          & "HTTP/" & major( digit() ) & '.' & minor( digit() ) & detail::eol();
+        return request_line & star( detail::HeaderField( req ) & detail::eol() ) & detail::eol();
+    }
+
+    /**
+     * @brief Incrementally parses a request head from the first len bytes of buf
+     * Returns Incomplete until the blank line ending the headers has arrived, the buffer
+     * need not be NUL terminated since parsing never passes the blank line. As in picohttpparser,
+     * last_len is the length of the previous incomplete attempt on the same buffer so that the
+     * search for the blank line resumes where it stopped rather than rescanning the whole head.
+     */
+    inline Result parse_request( const char* buf, size_t len, Request& req, size_t last_len=0, size_t max_head=65536 ){
+        // a blank line ends at most three bytes after the last byte seen before
+        const size_t resume = last_len < len && last_len > 3 ? last_len-3 : 0;
+        const char* end = detail::find_blank_line( buf+resume, buf+len );
+        if( !end ){
+            return { len > max_head ? Status::Error : Status::Incomplete };
+        }
+        if( size_t(end-buf) > max_head ){
+            return { Status::Error };
+        }
+        req = Request{};
+        if( auto ret = request( req ).match( buf ); ret && *ret == end ){
+            return { Status::Complete, size_t(end-buf) };
+        }
+        return { Status::Error };
+    }
+
+    /**
+     * @brief ChunkedDecoder, removes chunked transfer-coding framing in place, across calls
+     * Each call decodes buf[0,len) and sets len to the number of payload bytes moved to the front
+     * of buf. Complete means the last chunk and trailers were consumed and consumed reports the
+     * bytes of this call that belonged to the message; the rest belongs to the next message.
+     */
+    struct ChunkedDecoder {
+        Result decode( char* buf, size_t& len ){
+            size_t in = 0, out = 0;
+            while( in < len ){
+                const char c = buf[in];
+                switch( _state ){
+                    case State::Size:
+                        if( int d = hex_value(c) ; d >= 0 ){
+                            if( _remaining > (SIZE_MAX >> 4) ){
+                                return fail( len );
+                            }
+                            _remaining = _remaining*16 + d;
+                            _digits = true;
+                        } else if( !_digits ){
+                            return fail( len );
+                        } else if( c == ';' || c == ' ' || c == '\t' ){
+                            _state = State::Extension;
+                        } else if( c == '\r' ){
+                            _state = State::SizeLF;
+                        } else if( c == '\n' ){
+                            end_size_line();
+                        } else {
+                            return fail( len );
+                        }
+                        ++in;
+                        break;
+                    case State::Extension:
+                        if( c == '\r' ){
+                            _state = State::SizeLF;
+                        } else if( c == '\n' ){
+                            end_size_line();
+                        }
+                        ++in;
+                        break;
+                    case State::SizeLF:
+                        if( c != '\n' ){
+                            return fail( len );
+                        }
+                        end_size_line();
+                        ++in;
+                        break;
+                    case State::Data: {
+                        const size_t n = std::min( _remaining, len-in );
+                        std::memmove( buf+out, buf+in, n );
+                        in += n;
+                        out += n;
+                        _remaining -= n;
+                        if( _remaining == 0 ){
+                            _state = State::DataCR;
+                        }
+                        break;
+                    }
+                    case State::DataCR:
+                        if( c == '\r' ){
+                            _state = State::DataLF;
+                        } else if( c == '\n' ){
+                            _state = State::Size;
+                        } else {
+                            return fail( len );
+                        }
+                        ++in;
+                        break;
+                    case State::DataLF:
+                        if( c != '\n' ){
+                            return fail( len );
+                        }
+                        _state = State::Size;
+                        ++in;
+                        break;
+                    case State::Trailer:
+                        // trailer fields are skipped, an empty line ends the message
+                        if( c == '\n' ){
+                            if( _line_length == 0 ){
+                                ++in;
+                                _state = State::Done;
+                                len = out;
+                                return { Status::Complete, in };
+                            }
+                            _line_length = 0;
+                        } else if( c != '\r' ){
+                            ++_line_length;
+                        }
+                        ++in;
+                        break;
+                    case State::Done:
+                        len = out;
+                        return { Status::Complete, in };
+                }
+            }
+            len = out;
+            return { Status::Incomplete, in };
+        }
+
+        bool done() const { return _state == State::Done; }
+
+        enum class State { Size, Extension, SizeLF, Data, DataCR, DataLF, Trailer, Done };
+
+        static int hex_value( char c ){
+            if( c >= '0' && c <= '9' ) return c-'0';
+            if( c >= 'a' && c <= 'f' ) return c-'a'+10;
+            if( c >= 'A' && c <= 'F' ) return c-'A'+10;
+            return -1;
+        }
+
+        void end_size_line(){
+            _state  = _remaining ? State::Data : State::Trailer;
+            _digits = false;
+            _line_length = 0;
+        }
+
+        Result fail( size_t& len ){
+            len = 0;
+            return { Status::Error };
+        }
+
+        State  _state       = State::Size;
+        size_t _remaining   = 0;
+        size_t _line_length = 0;
+        bool   _digits      = false;
+    };
+};
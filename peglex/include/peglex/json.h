@@ -0,0 +1,393 @@
+// (c) James Gregson 2024, MIT license
+#pragma once
+
+#include <peglex/peglex.h>
+
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace peglex::json {
+
+    /**
+     * @brief SAX-style event handler, strings and numbers are passed as zero-copy views of the source
+     * String and key views exclude the quotes and are NOT unescaped, use json::unescape() if needed.
+     */
+    template< typename H >
+    concept Handler = requires( H& h, std::string_view s, bool b ){
+        h.null_value();
+        h.boolean(b);
+        h.number(s);
+        h.string(s);
+        h.key(s);
+        h.start_object();
+        h.end_object();
+        h.start_array();
+        h.end_array();
+    };
+
+    /**
+     * @brief Handler that ignores every event, used for validate-only parsing
+     */
+    struct NullHandler {
+        void null_value(){}
+        void boolean( bool ){}
+        void number( std::string_view ){}
+        void string( std::string_view ){}
+        void key( std::string_view ){}
+        void start_object(){}
+        void end_object(){}
+        void start_array(){}
+        void end_array(){}
+    };
+
+    namespace detail {
+        inline bool is_ws( char c ){
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        inline const char* skip_ws( const char* src ){
+            while( is_ws(*src) ){
+                ++src;
+            }
+            return src;
+        }
+
+        inline bool is_digit( char c ){
+            return c >= '0' && c <= '9';
+        }
+
+        inline bool is_hex( char c ){
+            return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+        }
+
+        // returns one past the closing quote of the string starting after the opening
+        // quote, or nullptr for malformed strings. Runs of plain characters are
+        // skipped with strcspn (vectorized in common C libraries) and then checked
+        // for unescaped control characters with a branch-free reduction.
+        inline const char* scan_string( const char* src ){
+            while( true ){
+                const size_t n = std::strcspn( src, "\"\\" );
+                unsigned char lo = 0xff;
+                for( size_t i=0; i<n; ++i ){
+                    lo = std::min( lo, static_cast<unsigned char>(src[i]) );
+                }
+                if( lo < 0x20 ){
+                    return nullptr;
+                }
+                src += n;
+                if( *src == '"' ){
+                    return src+1;
+                }
+                if( *src != '\\' ){
+                    return nullptr;
+                }
+                switch( src[1] ){
+                    case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+                        src += 2;
+                        break;
+                    case 'u':
+                        for( int i=2; i<6; ++i ){
+                            if( !is_hex(src[i]) ){
+                                return nullptr;
+                            }
+                        }
+                        src += 6;
+                        break;
+                    default:
+                        return nullptr;
+                }
+            }
+        }
+
+        // number = [ '-' ] ( '0' / [1-9] [0-9]* ) [ '.' [0-9]+ ] [ ( 'e' / 'E' ) [ '+' / '-' ] [0-9]+ ]
+        inline const char* scan_number( const char* src ){
+            if( *src == '-' ){
+                ++src;
+            }
+            if( *src == '0' ){
+                ++src;
+            } else if( is_digit(*src) ){
+                while( is_digit(*src) ){
+                    ++src;
+                }
+            } else {
+                return nullptr;
+            }
+            if( *src == '.' ){
+                ++src;
+                if( !is_digit(*src) ){
+                    return nullptr;
+                }
+                while( is_digit(*src) ){
+                    ++src;
+                }
+            }
+            if( *src == 'e' || *src == 'E' ){
+                ++src;
+                if( *src == '+' || *src == '-' ){
+                    ++src;
+                }
+                if( !is_digit(*src) ){
+                    return nullptr;
+                }
+                while( is_digit(*src) ){
+                    ++src;
+                }
+            }
+            return src;
+        }
+
+        inline const char* scan_literal( const char* src, const char* lit, size_t len ){
+            for( size_t i=0; i<len; ++i ){
+                if( src[i] != lit[i] ){
+                    return nullptr;
+                }
+            }
+            return src+len;
+        }
+    }
+
+    /**
+     * @brief Value, matches any RFC 8259 value without surrounding whitespace, emitting SAX events
+     * Nesting deeper than max_depth fails the match rather than exhausting the stack.
+     */
+    template< Handler H >
+    struct Value : public Pattern {
+        Value( H& handler, int max_depth=1024 ) : _handler{handler}, _max_depth{max_depth} {}
+        std::optional<const char*> match( const char* src ) const override {
+            if( const char* ret = src ? parse_value( src, 0 ) : nullptr ){
+                return ret;
+            }
+            return std::nullopt;
+        }
+
+        const char* parse_value( const char* src, int depth ) const {
+            switch( *src ){
+                case '{': return depth < _max_depth ? parse_object( src+1, depth+1 ) : nullptr;
+                case '[': return depth < _max_depth ? parse_array( src+1, depth+1 ) : nullptr;
+                case '"': {
+                    const char* end = detail::scan_string( src+1 );
+                    if( end ){
+                        _handler.string( std::string_view( src+1, end-src-2 ) );
+                    }
+                    return end;
+                }
+                case 't': {
+                    const char* end = detail::scan_literal( src, "true", 4 );
+                    if( end ){
+                        _handler.boolean(true);
+                    }
+                    return end;
+                }
+                case 'f': {
+                    const char* end = detail::scan_literal( src, "false", 5 );
+                    if( end ){
+                        _handler.boolean(false);
+                    }
+                    return end;
+                }
+                case 'n': {
+                    const char* end = detail::scan_literal( src, "null", 4 );
+                    if( end ){
+                        _handler.null_value();
+                    }
+                    return end;
+                }
+                default: {
+                    const char* end = detail::scan_number( src );
+                    if( end ){
+                        _handler.number( std::string_view( src, end-src ) );
+                    }
+                    return end;
+                }
+            }
+        }
+
+        // src points one past the '{'
+        const char* parse_object( const char* src, int depth ) const {
+            _handler.start_object();
+            src = detail::skip_ws( src );
+            if( *src == '}' ){
+                _handler.end_object();
+                return src+1;
+            }
+            while( true ){
+                if( *src != '"' ){
+                    return nullptr;
+                }
+                const char* end = detail::scan_string( src+1 );
+                if( !end ){
+                    return nullptr;
+                }
+                _handler.key( std::string_view( src+1, end-src-2 ) );
+                src = detail::skip_ws( end );
+                if( *src != ':' ){
+                    return nullptr;
+                }
+                src = parse_value( detail::skip_ws( src+1 ), depth );
+                if( !src ){
+                    return nullptr;
+                }
+                src = detail::skip_ws( src );
+                if( *src == '}' ){
+                    _handler.end_object();
+                    return src+1;
+                }
+                if( *src != ',' ){
+                    return nullptr;
+                }
+                src = detail::skip_ws( src+1 );
+            }
+        }
+
+        // src points one past the '['
+        const char* parse_array( const char* src, int depth ) const {
+            _handler.start_array();
+            src = detail::skip_ws( src );
+            if( *src == ']' ){
+                _handler.end_array();
+                return src+1;
+            }
+            while( true ){
+                src = parse_value( src, depth );
+                if( !src ){
+                    return nullptr;
+                }
+                src = detail::skip_ws( src );
+                if( *src == ']' ){
+                    _handler.end_array();
+                    return src+1;
+                }
+                if( *src != ',' ){
+                    return nullptr;
+                }
+                src = detail::skip_ws( src+1 );
+            }
+        }
+
+        H&        _handler;
+        const int _max_depth;
+    };
+
+    template< Handler H >
+    Value<H> value( H& handler, int max_depth=1024 ){
+        return Value<H>( handler, max_depth );
+    }
+
+    // NullHandler is stateless so one instance serves every validator
+    inline NullHandler null_handler;
+
+    template< Handler H >
+    Value<NullHandler> validator_of( const Value<H>& e ){
+        return Value<NullHandler>( null_handler, e._max_depth );
+    }
+
+    /**
+     * @brief Ws, matches optional JSON whitespace (space, tab, carriage return and newline)
+     */
+    struct Ws : public Pattern {
+        std::optional<const char*> match( const char* src ) const override {
+            if( src ){
+                return detail::skip_ws( src );
+            }
+            return std::nullopt;
+        }
+    };
+    inline Ws ws(){ return Ws(); }
+
+    // a complete JSON text: whitespace, one value, whitespace and end of input
+    template< Handler H >
+    auto document( H& handler, int max_depth=1024 ){
+        return ws() & value( handler, max_depth ) & ws() & eof();
+    }
+
+    // newline-delimited JSON, one value per line with optional trailing carriage returns
+    template< Handler H >
+    auto ndjson( H& handler, int max_depth=1024 ){
+        auto inline_ws = star( space() | tab() );
+        auto line = inline_ws & value( handler, max_depth ) & inline_ws & maybe('\r') & (newline() | check(eof()));
+        return star( line ) & eof();
+    }
+
+    // validate-only parsing, the empty handler lets the compiler drop all event code
+    inline bool validate( const char* src ){
+        return document( null_handler ).match( src ).has_value();
+    }
+
+    /**
+     * @brief Decodes the escapes of a raw string view passed to a handler, appending UTF-8 to out
+     * Returns false for malformed escapes or unpaired surrogates.
+     */
+    inline bool unescape( std::string_view raw, std::string& out ){
+        auto hex4 = []( const char* p ){
+            unsigned v = 0;
+            for( int i=0; i<4; ++i ){
+                const char c = p[i];
+                v = v*16 + ( c <= '9' ? c-'0' : (c|0x20)-'a'+10 );
+            }
+            return v;
+        };
+        auto utf8 = [&out]( unsigned cp ){
+            if( cp < 0x80 ){
+                out += char(cp);
+            } else if( cp < 0x800 ){
+                out += char(0xC0 | (cp >> 6));
+                out += char(0x80 | (cp & 0x3F));
+            } else if( cp < 0x10000 ){
+                out += char(0xE0 | (cp >> 12));
+                out += char(0x80 | ((cp >> 6) & 0x3F));
+                out += char(0x80 | (cp & 0x3F));
+            } else {
+                out += char(0xF0 | (cp >> 18));
+                out += char(0x80 | ((cp >> 12) & 0x3F));
+                out += char(0x80 | ((cp >> 6) & 0x3F));
+                out += char(0x80 | (cp & 0x3F));
+            }
+        };
+        for( size_t i=0; i<raw.size(); ++i ){
+            if( raw[i] != '\\' ){
+                out += raw[i];
+                continue;
+            }
+            if( ++i >= raw.size() ){
+                return false;
+            }
+            switch( raw[i] ){
+                case '"':  out += '"';  break;
+                case '\\': out += '\\'; break;
+                case '/':  out += '/';  break;
+                case 'b':  out += '\b'; break;
+                case 'f':  out += '\f'; break;
+                case 'n':  out += '\n'; break;
+                case 'r':  out += '\r'; break;
+                case 't':  out += '\t'; break;
+                case 'u': {
+                    if( i+4 >= raw.size() ){
+                        return false;
+                    }
+                    unsigned cp = hex4( raw.data()+i+1 );
+                    i += 4;
+                    if( cp >= 0xD800 && cp <= 0xDBFF ){
+                        if( i+6 >= raw.size() || raw[i+1] != '\\' || raw[i+2] != 'u' ){
+                            return false;
+                        }
+                        const unsigned lo = hex4( raw.data()+i+3 );
+                        if( lo < 0xDC00 || lo > 0xDFFF ){
+                            return false;
+                        }
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                        i += 6;
+                    } else if( cp >= 0xDC00 && cp <= 0xDFFF ){
+                        return false;
+                    }
+                    utf8( cp );
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return true;
+    }
+};
@@ -0,0 +1,302 @@
+// (c) James Gregson 2024, MIT license
+#pragma once
+
+#include <peglex/peglex.h>
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace peglex::logs {
+
+    namespace detail {
+        /**
+         * @brief Reset, default-constructs a record and always matches without advancing
+         */
+        template< typename Record >
+        struct Reset : public Pattern {
+            Reset( Record& record ) : _record{record} {}
+            std::optional<const char*> match( const char* src ) const override {
+                _record = Record{};
+                return src;
+            }
+            Record& _record;
+        };
+
+        template< typename Record >
+        Eps validator_of( const Reset<Record>& ){ return Eps(); }
+
+        // printable non-space ASCII and any byte of a multi-byte UTF-8 sequence
+        inline auto token_char(){ return range('!','~') | range('\x80','\xff'); }
+        inline auto token(){ return plus( token_char() ); }
+
+        // body of a double-quoted string with backslash escapes, excluding the quotes
+        inline auto quoted_body(){
+            return star( ( '\\' & range(' ','~') ) | ( ( !( Char('"') | '\\' | eof() ) ) & any() ) );
+        }
+    }
+
+    /**
+     * @brief Fields of an Apache/nginx combined log line, views point into the source line
+     * A host that is an address is decoded into address (network byte order, IPv4 in the first
+     * four bytes) with ip_version 4 or 6, otherwise ip_version is 0. time_ns is the decoded time
+     * in nanoseconds since the UTC epoch. method, target and protocol are split out of the request
+     * line as far as it is well formed, bytes is zero when logged as '-'.
+     */
+    struct CombinedEntry {
+        std::string_view       host;
+        int                    ip_version = 0;
+        std::array<uint8_t,16> address{};
+        std::string_view ident;
+        std::string_view user;
+        std::string_view time;
+        int64_t          time_ns = 0;
+        std::string_view request;
+        std::string_view method;
+        std::string_view target;
+        std::string_view protocol;
+        int              status = 0;
+        int64_t          bytes  = 0;
+        std::string_view referer;
+        std::string_view user_agent;
+    };
+
+    namespace detail {
+        /**
+         * @brief Host, matches a host name or address, decoding addresses into the entry
+         */
+        struct Host : public Pattern {
+            Host( CombinedEntry& entry ) : _entry{entry} {}
+            std::optional<const char*> match( const char* src ) const override {
+                if( !src ){
+                    return std::nullopt;
+                }
+                const char* end = src;
+                while( ( *end >= '!' && *end <= '~' ) || static_cast<unsigned char>(*end) >= 0x80 ){
+                    ++end;
+                }
+                if( end == src ){
+                    return std::nullopt;
+                }
+                uint32_t v4;
+                if( IPv4::decode( src, v4 ) == end ){
+                    _entry.ip_version = 4;
+                    _entry.address    = { uint8_t(v4 >> 24), uint8_t(v4 >> 16), uint8_t(v4 >> 8), uint8_t(v4) };
+                } else if( IPv6::decode( src, _entry.address ) == end ){
+                    _entry.ip_version = 6;
+                } else {
+                    _entry.ip_version = 0;
+                    _entry.address    = {};
+                }
+                return end;
+            }
+            CombinedEntry& _entry;
+        };
+
+        inline auto validator_of( const Host& ){ return token(); }
+
+        /**
+         * @brief ClfTime, matches a common log format time, e.g. 10/Oct/2000:13:55:36 -0700,
+         * and decodes it to nanoseconds since the UTC epoch like Timestamp
+         */
+        struct ClfTime : public Pattern {
+            ClfTime( TimestampCallbackFn fn={} ) : _fn{fn} {}
+            std::optional<const char*> match( const char* src ) const override {
+                int64_t nanos;
+                if( const char* ret = src ? decode( src, nanos ) : nullptr ){
+                    if( _fn ){
+                        _fn( nanos );
+                    }
+                    return ret;
+                }
+                return std::nullopt;
+            }
+
+            // DD '/' Mon '/' YYYY ':' HH ':' MM ':' SS SP ( '+' / '-' ) HHMM
+            static const char* decode( const char* src, int64_t& nanos ){
+                static constexpr const char* months[] = { "Jan","Feb","Mar","Apr","May","Jun","Jul","Aug","Sep","Oct","Nov","Dec" };
+                int day, mon = 0, c, yy, hour, min, sec, oh, om;
+                if( !peglex::detail::digits2( src, day ) || src[2] != '/' ){
+                    return nullptr;
+                }
+                while( mon < 12 && !( src[3] == months[mon][0] && src[4] == months[mon][1] && src[5] == months[mon][2] ) ){
+                    ++mon;
+                }
+                if( mon++ == 12 || src[6] != '/' || !peglex::detail::digits2( src+7, c ) || !peglex::detail::digits2( src+9, yy ) ||
+                    src[11] != ':' || !peglex::detail::digits2( src+12, hour ) || src[14] != ':' || !peglex::detail::digits2( src+15, min ) ||
+                    src[17] != ':' || !peglex::detail::digits2( src+18, sec ) || src[20] != ' ' || ( src[21] != '+' && src[21] != '-' ) ||
+                    !peglex::detail::digits2( src+22, oh ) || !peglex::detail::digits2( src+24, om ) ){
+                    return nullptr;
+                }
+                const int year = c*100 + yy;
+                if( year < 1678 || year > 2261 || day < 1 || day > peglex::detail::days_in_month( year, mon ) ||
+                    hour > 23 || min > 59 || sec > 60 || oh > 23 || om > 59 ){
+                    return nullptr;
+                }
+                const int offset = ( src[21] == '-' ? -1 : 1 ) * ( oh*3600 + om*60 );
+                nanos = ( peglex::detail::days_from_civil( year, mon, day )*86400 + hour*3600 + min*60 + sec - offset )*1000000000;
+                return src+26;
+            }
+
+            TimestampCallbackFn _fn;
+        };
+
+        inline ClfTime validator_of( const ClfTime& ){ return ClfTime(); }
+    }
+
+    // %h %l %u [%t] "%r" %>s %b "%{Referer}i" "%{User-agent}i", without the line terminator
+    inline auto combined( CombinedEntry& entry ){
+        using E = CombinedEntry;
+        auto [host,ident,user,time,request,method,target,protocol,status,bytes,referer,user_agent] =
+            fields<&E::host,&E::ident,&E::user,&E::time,&E::request,&E::method,&E::target,&E::protocol,&E::status,&E::bytes,&E::referer,&E::user_agent>(entry);
+
+        auto sp           = Char(' ');
+        auto request_line = method( plus(upper()) ) & sp & target( detail::token() ) & sp & protocol( "HTTP/" & digits() & '.' & digits() ) & '"';
+        return detail::Reset<E>( entry )
+             & host( detail::Host( entry ) ) & sp
+             & ident( detail::token() ) & sp
+             & user( detail::token() ) & sp
+             & '[' & time( detail::ClfTime( [&entry]( int64_t ns ){ entry.time_ns = ns; } ) ) & ']' & sp
+             & '"' & maybe( check( request_line ) ) & request( detail::quoted_body() ) & '"' & sp
+             & status( digits() ) & sp
+             & ( bytes( digits() ) | '-' )
+             & maybe( sp & '"' & referer( detail::quoted_body() ) & '"' & sp & '"' & user_agent( detail::quoted_body() ) & '"' );
+    }
+
+    /**
+     * @brief Fields of an RFC 5424 syslog message, NILVALUE fields ('-') are left empty
+     * time_ns is the decoded timestamp in nanoseconds since the UTC epoch, structured_data
+     * holds all SD-ELEMENTs verbatim and message excludes the separating space.
+     */
+    struct SyslogEntry {
+        int              priority = 0;
+        int              version  = 0;
+        std::string_view timestamp;
+        int64_t          time_ns  = 0;
+        std::string_view hostname;
+        std::string_view app_name;
+        std::string_view procid;
+        std::string_view msgid;
+        std::string_view structured_data;
+        std::string_view message;
+
+        int facility() const { return priority / 8; }
+        int severity() const { return priority % 8; }
+    };
+
+    // <PRI>VERSION SP TIMESTAMP SP HOSTNAME SP APP-NAME SP PROCID SP MSGID SP STRUCTURED-DATA [SP MSG]
+    inline auto syslog( SyslogEntry& entry ){
+        using E = SyslogEntry;
+        auto [priority,version,timestamp,hostname,app_name,procid,msgid,structured_data,message] =
+            fields<&E::priority,&E::version,&E::timestamp,&E::hostname,&E::app_name,&E::procid,&E::msgid,&E::structured_data,&E::message>(entry);
+
+        auto sp       = Char(' ');
+        auto nil      = Char('-') & check( sp | eof() );
+        auto header   = [&]( auto& f ){ return nil | f( detail::token() ); };
+        auto sd_name  = plus( range('!','!') | range('#','<') | range('>','\\') | range('^','~') );
+        auto sd_param = sd_name & '=' & '"' & star( ( '\\' & ( Char('"') | '\\' | ']' ) ) | ( ( !( Char('"') | '\\' | ']' | eof() ) ) & any() ) ) & '"';
+        auto sd_elem  = '[' & sd_name & star( sp & sd_param ) & ']';
+        auto line_end = newline() | carriage_return() | eof();
+        // PRIVAL is 0..191 without leading zeros
+        auto prival   = ( Char('1') & ( ( range('0','8') & digit() ) | ( '9' & range('0','1') ) | maybe( digit() ) ) )
+                      | ( range('2','9') & maybe( digit() ) )
+                      | '0';
+
+        return detail::Reset<E>( entry )
+             & '<' & priority( prival ) & '>'
+             & version( range('1','9') & maybe( digit() ) & maybe( digit() ) ) & sp
+             & ( nil | timestamp( Timestamp( [&entry]( int64_t ns ){ entry.time_ns = ns; } ) ) ) & sp
+             & header( hostname ) & sp
+             & header( app_name ) & sp
+             & header( procid ) & sp
+             & header( msgid ) & sp
+             & ( nil | structured_data( plus( sd_elem ) ) )
+             & maybe( sp & message( star( ( !line_end ) & any() ) ) );
+    }
+
+    /**
+     * @brief logfmt event handler, values exclude quotes and are not unescaped
+     */
+    template< typename H >
+    concept LogfmtHandler = requires( H& h, std::string_view s, bool quoted ){
+        h.pair( s, s, quoted );
+    };
+
+    /**
+     * @brief Logfmt, matches a line of space separated key=value pairs, without the line terminator
+     * Values may be bare, double-quoted with backslash escapes, or absent (`flag` or `key=`).
+     */
+    template< LogfmtHandler H >
+    struct Logfmt : public Pattern {
+        Logfmt( H& handler ) : _handler{handler} {}
+        std::optional<const char*> match( const char* src ) const override {
+            if( !src ){
+                return std::nullopt;
+            }
+            while( true ){
+                while( *src == ' ' || *src == '\t' ){
+                    ++src;
+                }
+                const char* key = src;
+                while( is_ident(*src) ){
+                    ++src;
+                }
+                if( src == key ){
+                    return end_of_line(*src) ? std::optional<const char*>(src) : std::nullopt;
+                }
+                const std::string_view name( key, src-key );
+                if( *src != '=' ){
+                    _handler.pair( name, std::string_view(), false );
+                    continue;
+                }
+                ++src;
+                if( *src == '"' ){
+                    const char* value = ++src;
+                    while( *src != '"' ){
+                        if( end_of_line(*src) ){
+                            return std::nullopt;
+                        }
+                        src += (*src == '\\' && src[1] && src[1] != '\n') ? 2 : 1;
+                    }
+                    _handler.pair( name, std::string_view( value, src-value ), true );
+                    ++src;
+                } else {
+                    const char* value = src;
+                    while( is_ident(*src) || *src == '=' ){
+                        ++src;
+                    }
+                    _handler.pair( name, std::string_view( value, src-value ), false );
+                }
+                if( !end_of_line(*src) && *src != ' ' && *src != '\t' ){
+                    return std::nullopt;
+                }
+            }
+        }
+
+        static bool is_ident( char c ){
+            return static_cast<unsigned char>(c) > ' ' && c != '=' && c != '"' && c != '\x7f';
+        }
+
+        static bool end_of_line( char c ){
+            return c == '\0' || c == '\n' || c == '\r';
+        }
+
+        H& _handler;
+    };
+
+    template< LogfmtHandler H >
+    Logfmt<H> logfmt( H& handler ){
+        return Logfmt<H>( handler );
+    }
+
+    struct NullLogfmtHandler {
+        void pair( std::string_view, std::string_view, bool ){}
+    };
+
+    inline NullLogfmtHandler null_logfmt_handler;
+
+    template< LogfmtHandler H >
+    Logfmt<NullLogfmtHandler> validator_of( const Logfmt<H>& ){
+        return Logfmt<NullLogfmtHandler>( null_logfmt_handler );
+    }
+};
@@ -2,12 +2,43 @@
 #pragma once 
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <charconv>
 #include <concepts>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 #include <functional>
-#include <iostream>
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
 #include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PEGLEX_HAS_MMAP 1
+#endif
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define PEGLEX_X86_DISPATCH 1
+#endif
 
 namespace peglex {
 
@@ -102,6 +133,519 @@ namespace peglex {
     };
     inline Str str( const char* seq ){ return Str(seq); }
 
+    namespace detail {
+        // bounds of the PaddedBuffer being matched on this thread, see PaddedScope
+        inline thread_local const char* padded_begin = nullptr;
+        inline thread_local const char* padded_end   = nullptr;
+    }
+
+    /**
+     * @brief PaddedBuffer, NUL terminated input followed by PaddedBuffer::padding readable zero bytes
+     * The data is 64-byte aligned. While a PaddedScope is active (e.g. within PaddedBuffer::match),
+     * nodes may load up to padding bytes past any position in the buffer without checking for
+     * the terminator first.
+     */
+    class PaddedBuffer {
+        public:
+        static constexpr size_t padding   = 64;
+        static constexpr size_t alignment = 64;
+
+        PaddedBuffer( std::string_view text ){
+            allocate( text.size() );
+            std::memcpy( _data, text.data(), text.size() );
+        }
+
+        PaddedBuffer( PaddedBuffer&& other ) noexcept : _data{std::exchange(other._data,nullptr)}, _size{std::exchange(other._size,0)}, _mapped{std::exchange(other._mapped,0)} {}
+
+        PaddedBuffer& operator=( PaddedBuffer&& other ) noexcept {
+            std::swap( _data, other._data );
+            std::swap( _size, other._size );
+            std::swap( _mapped, other._mapped );
+            return *this;
+        }
+
+        ~PaddedBuffer(){
+            release();
+        }
+
+        // reads a file into an allocated buffer
+        static PaddedBuffer from_file( const char* path ){
+            std::FILE* fp = std::fopen( path, "rb" );
+            if( !fp ){
+                throw std::runtime_error("Error: could not open file.");
+            }
+            PaddedBuffer buffer;
+            std::fseek( fp, 0, SEEK_END );
+            const long size = std::ftell( fp );
+            std::fseek( fp, 0, SEEK_SET );
+            buffer.allocate( size > 0 ? size_t(size) : 0 );
+            const bool ok = size >= 0 && std::fread( buffer._data, 1, buffer._size, fp ) == buffer._size;
+            std::fclose( fp );
+            if( !ok ){
+                throw std::runtime_error("Error: could not read file.");
+            }
+            return buffer;
+        }
+
+#ifdef PEGLEX_HAS_MMAP
+        /**
+         * @brief Maps a file without copying it
+         * The mapping reserves one page more than the file needs and maps the file over its start.
+         * The kernel zero-fills the rest of the last file page and the extra page is anonymous zeros,
+         * so the terminator and padding are readable without touching the file.
+         */
+        static PaddedBuffer map_file( const char* path ){
+            static_assert( padding < 4096, "padding must fit in the extra page" );
+            const int fd = ::open( path, O_RDONLY );
+            struct stat st;
+            if( fd < 0 || ::fstat( fd, &st ) != 0 ){
+                if( fd >= 0 ) ::close( fd );
+                throw std::runtime_error("Error: could not open file.");
+            }
+            const size_t page = size_t(::sysconf( _SC_PAGESIZE ));
+            const size_t size = size_t(st.st_size);
+            const size_t span = (size+padding)/page*page + page;
+            void* base = ::mmap( nullptr, span, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+            if( base != MAP_FAILED && size && ::mmap( base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0 ) == MAP_FAILED ){
+                ::munmap( base, span );
+                base = MAP_FAILED;
+            }
+            ::close( fd );
+            if( base == MAP_FAILED ){
+                throw std::runtime_error("Error: could not map file.");
+            }
+            PaddedBuffer buffer;
+            buffer._data   = static_cast<char*>(base);
+            buffer._size   = size;
+            buffer._mapped = span;
+            return buffer;
+        }
+#endif
+
+        const char* data() const { return _data; }
+        size_t size() const { return _size; }
+        std::string_view view() const { return { _data, _size }; }
+
+        // matches expr against the buffer with the padded fast paths enabled
+        template< typename Expr >
+        requires std::derived_from<Expr,Pattern>
+        std::optional<const char*> match( const Expr& expr ) const;
+
+        private:
+        PaddedBuffer() = default;
+
+        void allocate( size_t size ){
+            _size = size;
+            _data = static_cast<char*>( ::operator new( size+1+padding, std::align_val_t{alignment} ) );
+            std::memset( _data+size, 0, 1+padding );
+        }
+
+        void release(){
+#ifdef PEGLEX_HAS_MMAP
+            if( _mapped ){
+                ::munmap( _data, _mapped );
+                return;
+            }
+#endif
+            if( _data ){
+                ::operator delete( _data, std::align_val_t{alignment} );
+            }
+        }
+
+        char*  _data   = nullptr;
+        size_t _size   = 0;
+        size_t _mapped = 0;
+    };
+
+    /**
+     * @brief PaddedScope, marks a PaddedBuffer as the input of the current thread for its lifetime
+     */
+    struct PaddedScope {
+        PaddedScope( const PaddedBuffer& buffer ) : _begin{detail::padded_begin}, _end{detail::padded_end} {
+            detail::padded_begin = buffer.data();
+            detail::padded_end   = buffer.data()+buffer.size();
+        }
+        ~PaddedScope(){
+            detail::padded_begin = _begin;
+            detail::padded_end   = _end;
+        }
+        PaddedScope( const PaddedScope& ) = delete;
+        PaddedScope& operator=( const PaddedScope& ) = delete;
+        const char* _begin;
+        const char* _end;
+    };
+
+    template< typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    std::optional<const char*> PaddedBuffer::match( const Expr& expr ) const {
+        PaddedScope scope( *this );
+        return expr.match( _data );
+    }
+
+    namespace detail {
+        // true if PaddedBuffer::padding bytes from src onward may be read without bounds checks
+        inline bool padded( const char* src ){
+            return padded_begin && src >= padded_begin && src <= padded_end;
+        }
+    }
+
+    /**
+     * @brief FixedString, string literal usable as a non-type template parameter
+     */
+    template< size_t N >
+    struct FixedString {
+        constexpr FixedString( const char (&s)[N] ){
+            std::copy_n( s, N, _data );
+        }
+        constexpr size_t size() const { return N-1; }
+        char _data[N];
+    };
+
+    /**
+     * @brief Lit, matches a string fixed at compile time, e.g. lit<"while">()
+     * The comparison is unrolled over the known length and needs no NUL checks: the literal
+     * contains no NUL, so the terminator of the source fails the comparison like any other mismatch.
+     */
+    template< FixedString S >
+    struct Lit : public Pattern {
+        static_assert( std::char_traits<char>::length( S._data ) == S.size(), "literal cannot contain NUL" );
+        static constexpr std::string_view text{ S._data, S.size() };
+        std::optional<const char*> match( const char* src ) const override {
+            if( !src ){
+                return std::nullopt;
+            }
+            if constexpr ( words*8 <= PaddedBuffer::padding ){
+                if( detail::padded( src ) ){
+                    return equal_words( src, std::make_index_sequence<words>() ) ? std::optional<const char*>(src+S.size()) : std::nullopt;
+                }
+            }
+            if( equal( src, std::make_index_sequence<S.size()>() ) ){
+                return src+S.size();
+            }
+            return std::nullopt;
+        }
+        template< size_t... I >
+        static bool equal( const char* src, std::index_sequence<I...> ){
+            return ( ( src[I] == S._data[I] ) && ... );
+        }
+
+        // padded input: a few branch-free 8-byte compares with the tail masked off
+        static constexpr size_t words = (S.size()+7)/8;
+        static constexpr auto packed = []{
+            std::array<std::pair<uint64_t,uint64_t>,words> w{};
+            for( size_t i=0; i<S.size(); ++i ){
+                const int shift = std::endian::native == std::endian::little ? 8*(i%8) : 8*(7-i%8);
+                w[i/8].first  |= uint64_t(uint8_t(S._data[i])) << shift;
+                w[i/8].second |= uint64_t(0xff) << shift;
+            }
+            return w;
+        }();
+        template< size_t... I >
+        static bool equal_words( const char* src, std::index_sequence<I...> ){
+            auto diff = [src]( size_t i ){
+                uint64_t v;
+                std::memcpy( &v, src+8*i, 8 );
+                return (v ^ packed[i].first) & packed[i].second;
+            };
+            return ( diff(I) | ... | 0 ) == 0;
+        }
+    };
+    template< FixedString S >
+    Lit<S> lit(){ return Lit<S>(); }
+
+    template< typename T >
+    struct is_lit : std::false_type {};
+    template< FixedString S >
+    struct is_lit< Lit<S> > : std::true_type {};
+
+    /**
+     * @brief Scanning kernels over [begin,end), none of them read past end
+     * Vector variants are compiled per instruction set with target attributes so that a baseline
+     * build still gets the widest kernels the CPU supports; simd::kernels() picks them once at
+     * first use. find_any handles sets of up to 16 characters in the vector kernels.
+     */
+    namespace simd {
+        namespace scalar {
+            inline const char* find_any( const char* begin, const char* end, std::string_view set ){
+                for( ; begin < end; ++begin ){
+                    if( std::memchr( set.data(), *begin, set.size() ) ){
+                        return begin;
+                    }
+                }
+                return end;
+            }
+
+            inline bool equal( const char* a, const char* b, size_t n ){
+                return std::memcmp( a, b, n ) == 0;
+            }
+
+            inline const char* find_substring( const char* begin, const char* end, std::string_view needle ){
+                if( needle.empty() ){
+                    return begin;
+                }
+                for( ; begin+needle.size() <= end; ++begin ){
+                    if( *begin == needle[0] && equal( begin, needle.data(), needle.size() ) ){
+                        return begin;
+                    }
+                }
+                return end;
+            }
+
+            inline void classify( const char* src, size_t blocks, std::string_view set, uint64_t* out ){
+                const size_t n = std::min<size_t>( set.size(), 16 );
+                for( size_t b=0; b<blocks; ++b, src += 64, out += n ){
+                    for( size_t i=0; i<n; ++i ){
+                        uint64_t mask = 0;
+                        for( size_t j=0; j<64; ++j ){
+                            mask |= uint64_t( src[j] == set[i] ) << j;
+                        }
+                        out[i] = mask;
+                    }
+                }
+            }
+        }
+
+#ifdef PEGLEX_X86_DISPATCH
+        // one variant per vector width, V is the register type and the helpers wrap its intrinsics
+        #define PEGLEX_SIMD_KERNELS( ns, isa, V, width, load, set1, cmpeq_mask, Mask ) \
+        namespace ns { \
+            __attribute__((target(isa))) inline const char* find_any( const char* begin, const char* end, std::string_view set ){ \
+                V needles[16]; \
+                const size_t n = std::min<size_t>( set.size(), 16 ); \
+                for( size_t i=0; i<n; ++i ){ \
+                    needles[i] = set1( set[i] ); \
+                } \
+                for( ; begin+width <= end; begin += width ){ \
+                    const V block = load( begin ); \
+                    Mask mask = 0; \
+                    for( size_t i=0; i<n; ++i ){ \
+                        mask |= cmpeq_mask( block, needles[i] ); \
+                    } \
+                    if( mask ){ \
+                        return begin + std::countr_zero( mask ); \
+                    } \
+                } \
+                return scalar::find_any( begin, end, set ); \
+            } \
+            __attribute__((target(isa))) inline bool equal( const char* a, const char* b, size_t n ){ \
+                constexpr Mask all = Mask(~Mask(0)) >> (8*sizeof(Mask) - width); \
+                for( ; n >= width; a += width, b += width, n -= width ){ \
+                    if( cmpeq_mask( load(a), load(b) ) != all ){ \
+                        return false; \
+                    } \
+                } \
+                return scalar::equal( a, b, n ); \
+            } \
+            /* compares the first and last needle characters across a block, verifying candidates */ \
+            __attribute__((target(isa))) inline const char* find_substring( const char* begin, const char* end, std::string_view needle ){ \
+                const size_t k = needle.size(); \
+                if( k < 2 ){ \
+                    return k ? find_any( begin, end, needle ) : begin; \
+                } \
+                const V first = set1( needle[0] ); \
+                const V last  = set1( needle[k-1] ); \
+                for( ; begin+k-1+width <= end; begin += width ){ \
+                    Mask mask = cmpeq_mask( load(begin), first ) & cmpeq_mask( load(begin+k-1), last ); \
+                    for( ; mask; mask &= mask-1 ){ \
+                        const char* candidate = begin + std::countr_zero( mask ); \
+                        if( equal( candidate+1, needle.data()+1, k-2 ) ){ \
+                            return candidate; \
+                        } \
+                    } \
+                } \
+                return scalar::find_substring( begin, end, needle ); \
+            } \
+            /* one bitmap per set character and 64-byte block, each block is loaded once */ \
+            __attribute__((target(isa))) inline void classify( const char* src, size_t blocks, std::string_view set, uint64_t* out ){ \
+                V needles[16]; \
+                const size_t n = std::min<size_t>( set.size(), 16 ); \
+                for( size_t i=0; i<n; ++i ){ \
+                    needles[i] = set1( set[i] ); \
+                } \
+                for( size_t b=0; b<blocks; ++b, src += 64, out += n ){ \
+                    V chunk[64/width]; \
+                    for( size_t j=0; j<64/width; ++j ){ \
+                        chunk[j] = load( src+j*width ); \
+                    } \
+                    for( size_t i=0; i<n; ++i ){ \
+                        uint64_t mask = 0; \
+                        for( size_t j=0; j<64/width; ++j ){ \
+                            mask |= uint64_t( cmpeq_mask( chunk[j], needles[i] ) ) << (j*width); \
+                        } \
+                        out[i] = mask; \
+                    } \
+                } \
+            } \
+        }
+
+        namespace detail {
+            __attribute__((target("sse2"))) inline __m128i load128( const char* p ){ return _mm_loadu_si128( reinterpret_cast<const __m128i*>(p) ); }
+            __attribute__((target("sse2"))) inline __m128i set128( char c ){ return _mm_set1_epi8( c ); }
+            __attribute__((target("sse2"))) inline uint32_t eq128( __m128i a, __m128i b ){ return uint16_t(_mm_movemask_epi8( _mm_cmpeq_epi8( a, b ) )); }
+            __attribute__((target("avx2"))) inline __m256i load256( const char* p ){ return _mm256_loadu_si256( reinterpret_cast<const __m256i*>(p) ); }
+            __attribute__((target("avx2"))) inline __m256i set256( char c ){ return _mm256_set1_epi8( c ); }
+            __attribute__((target("avx2"))) inline uint32_t eq256( __m256i a, __m256i b ){ return uint32_t(_mm256_movemask_epi8( _mm256_cmpeq_epi8( a, b ) )); }
+            __attribute__((target("avx512f,avx512bw"))) inline __m512i load512( const char* p ){ return _mm512_loadu_si512( p ); }
+            __attribute__((target("avx512f,avx512bw"))) inline __m512i set512( char c ){ return _mm512_set1_epi8( c ); }
+            __attribute__((target("avx512f,avx512bw"))) inline uint64_t eq512( __m512i a, __m512i b ){ return _mm512_cmpeq_epi8_mask( a, b ); }
+        }
+
+        PEGLEX_SIMD_KERNELS( sse2,   "sse2",             __m128i, 16, detail::load128, detail::set128, detail::eq128, uint32_t )
+        PEGLEX_SIMD_KERNELS( avx2,   "avx2",             __m256i, 32, detail::load256, detail::set256, detail::eq256, uint32_t )
+        PEGLEX_SIMD_KERNELS( avx512, "avx512f,avx512bw", __m512i, 64, detail::load512, detail::set512, detail::eq512, uint64_t )
+        #undef PEGLEX_SIMD_KERNELS
+#endif
+
+        struct Kernels {
+            const char* (*find_any)( const char*, const char*, std::string_view );
+            const char* (*find_substring)( const char*, const char*, std::string_view );
+            bool        (*equal)( const char*, const char*, size_t );
+            void        (*classify)( const char*, size_t, std::string_view, uint64_t* );
+        };
+
+        // the widest kernels supported by the running CPU, chosen once
+        inline const Kernels& kernels(){
+            static const Kernels selected = []{
+#ifdef PEGLEX_X86_DISPATCH
+                __builtin_cpu_init();
+                if( __builtin_cpu_supports("avx512bw") ){
+                    return Kernels{ avx512::find_any, avx512::find_substring, avx512::equal, avx512::classify };
+                }
+                if( __builtin_cpu_supports("avx2") ){
+                    return Kernels{ avx2::find_any, avx2::find_substring, avx2::equal, avx2::classify };
+                }
+                return Kernels{ sse2::find_any, sse2::find_substring, sse2::equal, sse2::classify };
+#else
+                return Kernels{ scalar::find_any, scalar::find_substring, scalar::equal, scalar::classify };
+#endif
+            }();
+            return selected;
+        }
+
+        inline const char* find_any( const char* begin, const char* end, std::string_view set ){
+            return set.size() <= 16 ? kernels().find_any( begin, end, set ) : scalar::find_any( begin, end, set );
+        }
+
+        inline const char* find_substring( const char* begin, const char* end, std::string_view needle ){
+            return kernels().find_substring( begin, end, needle );
+        }
+
+        inline bool equal( const char* a, const char* b, size_t n ){
+            return kernels().equal( a, b, n );
+        }
+
+        // reads blocks*64 bytes from src and writes blocks*set.size() masks, set.size() <= 16
+        inline void classify( const char* src, size_t blocks, std::string_view set, uint64_t* out ){
+            kernels().classify( src, blocks, set, out );
+        }
+    }
+
+    /**
+     * @brief StructuralIndex, bitmaps of the structural characters of a PaddedBuffer built in one pass
+     * Up to 15 characters can be declared structural (quotes, delimiters, brackets, newlines...).
+     * The terminator is always indexed, so queries stop at the end of the input or at embedded NULs.
+     * While index.match(expr) runs, until(c) for an indexed c walks the bitmaps instead of the bytes.
+     */
+    class StructuralIndex {
+        public:
+        StructuralIndex( const PaddedBuffer& buffer, std::string_view structural, std::pmr::memory_resource* resource=std::pmr::get_default_resource() )
+            : _buffer{&buffer}, _bits{resource} {
+            if( structural.size() >= _set.size() ){
+                throw std::runtime_error("Error: too many structural characters.");
+            }
+            _set[0] = '\0';
+            std::copy( structural.begin(), structural.end(), _set.begin()+1 );
+            _stride = structural.size()+1;
+            const size_t blocks = (buffer.size()+64)/64;
+            _bits.resize( blocks*_stride );
+            simd::classify( buffer.data(), blocks, { _set.data(), _stride }, _bits.data() );
+        }
+
+        bool indexed( char c ) const {
+            return c && std::find( _set.begin()+1, _set.begin()+_stride, c ) != _set.begin()+_stride;
+        }
+
+        bool covers( const char* p ) const {
+            return p >= _buffer->data() && p <= _buffer->data()+_buffer->size();
+        }
+
+        // first occurrence of the indexed character c at or after p, or of the terminator if sooner,
+        // throws if c is not indexed
+        const char* find( const char* p, char c ) const {
+            const size_t k   = slot( c );
+            size_t       pos = p-_buffer->data();
+            size_t       w   = pos/64;
+            uint64_t     m   = mask( w, k ) & (~uint64_t(0) << (pos%64));
+            while( !m ){
+                m = mask( ++w, k );
+            }
+            return _buffer->data() + w*64 + std::countr_zero( m );
+        }
+
+        // number of occurrences of the indexed character c in [begin,end), throws if c is not indexed
+        size_t count( const char* begin, const char* end, char c ) const {
+            const size_t k  = slot( c );
+            const size_t lo = begin-_buffer->data(), hi = end-_buffer->data();
+            if( lo >= hi ){
+                return 0;
+            }
+            size_t total = 0;
+            for( size_t w=lo/64; w*64 < hi; ++w ){
+                uint64_t m = _bits[w*_stride+k];
+                if( w == lo/64 ){
+                    m &= ~uint64_t(0) << (lo%64);
+                }
+                if( w == (hi-1)/64 && hi%64 ){
+                    m &= ~uint64_t(0) >> (64-hi%64);
+                }
+                total += std::popcount( m );
+            }
+            return total;
+        }
+
+        const PaddedBuffer& buffer() const { return *_buffer; }
+
+        // matches expr against the buffer with the index and the padded fast paths enabled
+        template< typename Expr >
+        requires std::derived_from<Expr,Pattern>
+        std::optional<const char*> match( const Expr& expr ) const;
+
+        private:
+        size_t slot( char c ) const {
+            const size_t k = std::find( _set.begin()+1, _set.begin()+_stride, c ) - _set.begin();
+            if( k == _stride ){
+                throw std::runtime_error("Error: character is not indexed.");
+            }
+            return k;
+        }
+
+        uint64_t mask( size_t w, size_t k ) const {
+            return _bits[w*_stride+k] | _bits[w*_stride];
+        }
+
+        const PaddedBuffer*        _buffer;
+        std::array<char,16>        _set{};
+        size_t                     _stride = 0;
+        std::pmr::vector<uint64_t> _bits;
+    };
+
+    namespace detail {
+        // index of the buffer being matched on this thread, see StructuralIndex::match
+        inline thread_local const StructuralIndex* structural_index = nullptr;
+    }
+
+    template< typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    std::optional<const char*> StructuralIndex::match( const Expr& expr ) const {
+        struct Restore {
+            ~Restore(){ detail::structural_index = _outer; }
+            const StructuralIndex* _outer;
+        };
+        PaddedScope scope( *_buffer );
+        Restore restore{ std::exchange( detail::structural_index, this ) };
+        return expr.match( _buffer->data() );
+    }
+
     /**
      * @brief Check, matches the provided expression, rewinding input on success
      */
@@ -139,6 +683,170 @@ namespace peglex {
     };
 
 
+    template< typename Left, typename Right >
+    requires std::derived_from<Left,Pattern> && std::derived_from<Right,Pattern>
+    struct Or;
+
+    template< typename Left, typename Right >
+    requires std::derived_from<Left,Pattern> && std::derived_from<Right,Pattern>
+    struct And;
+
+    namespace detail {
+        // character classes: single-character patterns built from Char, Range and Or
+        template< typename T >
+        struct is_class : std::false_type {};
+        template<> struct is_class<Char>  : std::true_type {};
+        template<> struct is_class<Range> : std::true_type {};
+        template< typename Left, typename Right >
+        struct is_class< Or<Left,Right> > : std::bool_constant< is_class<Left>::value && is_class<Right>::value > {};
+
+        using ClassTable = std::array<bool,256>;
+
+        // compares as char like the nodes themselves, so ranges keep their signed-char meaning
+        inline void add_class( ClassTable& table, const Char& e ){
+            table[static_cast<unsigned char>(e._c)] = true;
+        }
+        inline void add_class( ClassTable& table, const Range& e ){
+            for( int b=0; b<256; ++b ){
+                table[b] = table[b] || ( char(b) >= e._lo && char(b) <= e._hi );
+            }
+        }
+        template< typename Left, typename Right >
+        void add_class( ClassTable& table, const Or<Left,Right>& e ){
+            add_class( table, e._left );
+            add_class( table, e._right );
+        }
+        template< typename Expr >
+        ClassTable class_table( const Expr& expr, bool complement=false ){
+            ClassTable table{};
+            add_class( table, expr );
+            if( complement ){
+                for( bool& b : table ){
+                    b = !b;
+                }
+            }
+            return table;
+        }
+
+        /**
+         * @brief ClassScan, finds the first byte of a stop set, the terminator always stops the scan
+         * Small stop sets use strcspn or the dispatched kernels on padded buffers, small continue
+         * sets use strspn and anything else a table lookup per byte.
+         */
+        struct ClassScan {
+            ClassScan( const ClassTable& stop ) : _stop{stop} {
+                _stop[0] = true;
+                const auto stops = std::count( _stop.begin()+1, _stop.end(), true );
+                const bool reject = stops < long(_chars.size());
+                if( reject || 255-stops < long(_chars.size()) ){
+                    _mode = reject ? Mode::Reject : Mode::Accept;
+                    for( int b=1; b<256; ++b ){
+                        if( _stop[b] == reject ){
+                            _chars[_size++] = char(b);
+                        }
+                    }
+                }
+            }
+            const char* scan( const char* src ) const {
+                switch( _mode ){
+                    case Mode::Reject:
+                        if( padded( src ) ){
+                            return simd::find_any( src, padded_end+PaddedBuffer::padding, { _chars.data(), _size+1 } );
+                        }
+                        return src + std::strcspn( src, _chars.data() );
+                    case Mode::Accept:
+                        return src + std::strspn( src, _chars.data() );
+                    default:
+                        while( !_stop[static_cast<unsigned char>(*src)] ){
+                            ++src;
+                        }
+                        return src;
+                }
+            }
+            enum class Mode { Reject, Accept, Table };
+            ClassTable           _stop;
+            std::array<char,16>  _chars{};
+            size_t               _size = 0;
+            Mode                 _mode = Mode::Table;
+        };
+
+        // scans are built once per stop set and shared, so that nodes only hold a pointer
+        inline const ClassScan* class_scan( const ClassTable& stop ){
+            static std::mutex lock;
+            static std::map<ClassTable,ClassScan> scans;
+            std::lock_guard<std::mutex> guard( lock );
+            return &scans.try_emplace( stop, stop ).first->second;
+        }
+
+        // nodes with side effects that a failed alternative must take back, e.g. columns, rows and
+        // symbol stacks, opt in here; composites inherit it from their children
+        template< typename T >
+        struct undoable : std::false_type {};
+
+        /**
+         * @brief Journal, per-thread undo log for the side effects of nodes in open choice points
+         * Entries are only recorded while a choice point is open and are dropped when the
+         * outermost one closes, so the log is bounded by the effects of the pending alternatives.
+         */
+        struct Journal {
+            struct Entry {
+                void (*undo)( const Entry& );
+                void*            target;
+                size_t           size;
+                std::string_view span;
+            };
+            void record( const Entry& e ){
+                if( open ){
+                    entries.push_back( e );
+                }
+            }
+            void unwind( size_t mark ){
+                while( entries.size() > mark ){
+                    const Entry e = entries.back();
+                    entries.pop_back();
+                    e.undo( e );
+                }
+            }
+            std::vector<Entry> entries;
+            size_t             open = 0;
+        };
+        inline thread_local Journal journal;
+
+        /**
+         * @brief ChoicePoint, marks the journal on construction, unwind() takes back what followed
+         */
+        class ChoicePoint {
+            public:
+            ChoicePoint() : _journal{journal}, _mark{_journal.entries.size()} { ++_journal.open; }
+            ChoicePoint( const ChoicePoint& ) = delete;
+            ChoicePoint& operator=( const ChoicePoint& ) = delete;
+            ~ChoicePoint(){
+                if( --_journal.open == 0 ){
+                    _journal.entries.clear();
+                }
+            }
+            void unwind(){ _journal.unwind( _mark ); }
+            private:
+            Journal& _journal;
+            size_t   _mark;
+        };
+
+        // matches one alternative, taking back its side effects if it fails
+        template< typename Expr >
+        std::optional<const char*> attempt( const Expr& expr, const char* src ){
+            if constexpr ( undoable<Expr>::value ){
+                ChoicePoint choice;
+                auto ret = expr.Expr::match( src );
+                if( !ret ){
+                    choice.unwind();
+                }
+                return ret;
+            } else {
+                return expr.Expr::match( src );
+            }
+        }
+    }
+
     /**
      * @brief Zero-plus, matches provided expression zero or more times, greedily
      */
@@ -148,7 +856,7 @@ namespace peglex {
         ZeroPlus( const Expr& expr ) : _expr{expr} {}
         std::optional<const char*> match( const char* src ) const override {
             while( src ){
-                if( auto tmp = _expr.match( src ) ){
+                if( auto tmp = detail::attempt( _expr, src ) ){
                     src = *tmp;
                 } else {
                     return {src};
@@ -158,6 +866,35 @@ namespace peglex {
         }
         const Expr _expr;
     };
+    /**
+     * @brief Zero-plus over a character class, e.g. star(digit()), scans for the end of the run
+     * Unlike the generic loop, a class that matches the terminator stops there instead of looping.
+     */
+    template< typename Expr >
+    requires std::derived_from<Expr,Pattern> && detail::is_class<Expr>::value
+    struct ZeroPlus<Expr> : public Pattern {
+        ZeroPlus( const Expr& expr ) : _expr{expr}, _scan{ detail::class_scan( detail::class_table( expr, true ) ) } {}
+        std::optional<const char*> match( const char* src ) const override {
+            return src ? _scan->scan( src ) : src;
+        }
+        const Expr               _expr;
+        const detail::ClassScan* _scan;
+    };
+
+    /**
+     * @brief Zero-plus of "anything but a class", e.g. star(!Char('"') & any()), scans for the class
+     */
+    template< typename Expr >
+    requires detail::is_class<Expr>::value
+    struct ZeroPlus< And<Not<Expr>,Any> > : public Pattern {
+        ZeroPlus( const And<Not<Expr>,Any>& expr ) : _expr{expr}, _scan{ detail::class_scan( detail::class_table( expr._left._expr ) ) } {}
+        std::optional<const char*> match( const char* src ) const override {
+            return src ? _scan->scan( src ) : src;
+        }
+        const And<Not<Expr>,Any> _expr;
+        const detail::ClassScan* _scan;
+    };
+
     template< typename Expr >
     ZeroPlus<Expr> star( const Expr& expr ){ return ZeroPlus<Expr>(expr); }
     inline ZeroPlus<Char> star( const char c ){ return ZeroPlus<Char>(c); }
@@ -173,8 +910,35 @@ namespace peglex {
     struct Until : public Pattern {
         Until( const Expr& expr ) : _expr{expr} {}
         std::optional<const char*> match( const char* src ) const override {
+            // characters and literals are searched for with the scanning kernels
+            if constexpr ( std::is_same_v<Expr,Char> ){
+                const char set[] = { _expr._c, '\0' };
+                const StructuralIndex* index = detail::structural_index;
+                const char* ret = !src || !*src ? nullptr
+                                : index && index->covers( src ) && index->indexed( _expr._c ) ? index->find( src, _expr._c )
+                                : detail::padded( src ) ? simd::find_any( src, detail::padded_end+PaddedBuffer::padding, {set,2} )
+                                : std::strchr( src, _expr._c );
+                return ret && *ret ? std::optional<const char*>(ret) : std::nullopt;
+            } else if constexpr ( std::is_same_v<Expr,Str> ){
+                const char* ret = src && *src ? std::strstr( src, _expr._seq ) : nullptr;
+                return ret ? std::optional<const char*>(ret) : std::nullopt;
+            } else if constexpr ( is_lit<Expr>::value ){
+                if( !src || !*src ){
+                    return std::nullopt;
+                }
+                if( detail::padded( src ) ){
+                    const char* ret = simd::find_substring( src, detail::padded_end, Expr::text );
+                    const char nul[] = { '\0' };
+                    if( ret == detail::padded_end || simd::find_any( src, ret, {nul,1} ) != ret ){
+                        return std::nullopt;
+                    }
+                    return ret;
+                }
+                const char* ret = std::strstr( src, Expr::text.data() );
+                return ret ? std::optional<const char*>(ret) : std::nullopt;
+            }
             while( src && *src ){
-                if( auto tmp = _expr.match(src) ){
+                if( auto tmp = detail::attempt( _expr, src ) ){
                     return src;                               
                 } else {
                     ++src;
@@ -184,6 +948,33 @@ namespace peglex {
         }
         const Expr _expr;
     };
+    /**
+     * @brief Until a character class or a lookahead of one, scans for the first member of the class
+     */
+    template< typename Expr >
+    requires std::derived_from<Expr,Pattern> && detail::is_class<Expr>::value && (!std::is_same_v<Expr,Char>)
+    struct Until<Expr> : public Pattern {
+        Until( const Expr& expr ) : _expr{expr}, _scan{ detail::class_scan( detail::class_table( expr ) ) } {}
+        std::optional<const char*> match( const char* src ) const override {
+            const char* ret = src && *src ? _scan->scan( src ) : nullptr;
+            return ret && *ret ? std::optional<const char*>(ret) : std::nullopt;
+        }
+        const Expr               _expr;
+        const detail::ClassScan* _scan;
+    };
+
+    template< typename Expr >
+    requires detail::is_class<Expr>::value
+    struct Until< Check<Expr> > : public Pattern {
+        Until( const Check<Expr>& expr ) : _expr{expr}, _scan{ detail::class_scan( detail::class_table( expr._expr ) ) } {}
+        std::optional<const char*> match( const char* src ) const override {
+            const char* ret = src && *src ? _scan->scan( src ) : nullptr;
+            return ret && *ret ? std::optional<const char*>(ret) : std::nullopt;
+        }
+        const Check<Expr>        _expr;
+        const detail::ClassScan* _scan;
+    };
+
     template< typename Expr >
     Until<Expr> until( const Expr& expr ){ return Until<Expr>(expr); }
     inline Until<Char> until( const char c ){ return Until<Char>(c); }
@@ -197,7 +988,7 @@ namespace peglex {
     struct Or : public Pattern {
         Or( const Left& left, const Right& right ) : _left{left}, _right{right} {}
         std::optional<const char*> match( const char* src ) const override {
-            if( auto res = _left.match(src) ){
+            if( auto res = detail::attempt( _left, src ) ){
                 return res;
             }
             return _right.match(src);
@@ -246,143 +1037,1735 @@ namespace peglex {
     // implement recursive grammars
     using UserFn = std::function<std::optional<const char*>(const char*)>;
 
+    // The optional validator matches the same language without side effects, validator_of
+    // swaps it in for the function.
     struct User : public Pattern {
-        User( UserFn fn ) : _fn(fn) {}
+        User( UserFn fn, UserFn validator={} ) : _fn(fn), _validator(validator) {}
         std::optional<const char*> match( const char* src ) const override {
             return _fn(src);
         }
         UserFn _fn;
+        UserFn _validator;
     };
 
     inline User cb( UserFn fn ){
         return User(fn);
     }
 
-    // called whenever a given token matches
-    using ExistCallbackFn   = std::function<void()>;
-    using MissingCallbackFn = std::function<void()>; 
+    inline User cb( UserFn fn, UserFn validator ){
+        return User(fn,validator);
+    }
 
-    inline void defaultExistFn(){}
-    inline void defaultMissingFn(){}
+    /**
+     * @brief Nfa, matches a short regular pattern with a bit-parallel Glushkov automaton
+     * Patterns use regex syntax: literal bytes, '.', [classes] with ranges and '^', the escapes
+     * \d \w \s \n \r \t \xHH, groups, '|' and the quantifiers * + ? {m} {m,} {m,n}. Every atom is
+     * one of at most 64 positions and each input byte advances all active positions at once with a
+     * table lookup per 8 positions, or a single shift when the pattern is a plain sequence. Unlike
+     * the PEG operators the match is the longest one, as in regex engines, and a pattern that
+     * matches nothing fails. Copies share the tables.
+     */
+    struct Nfa : public Pattern {
+        static constexpr size_t max_positions = 64;
+
+        Nfa( std::string_view pattern );
 
-    template< typename Expr >
-    requires std::derived_from<Expr,Pattern>
-    struct ExistCallback : public Pattern {
-        ExistCallback( const Expr& expr, ExistCallbackFn exist_fn, MissingCallbackFn missing_fn ) : _expr{expr}, _exist_fn{exist_fn}, _missing_fn{missing_fn} {}
         std::optional<const char*> match( const char* src ) const override {
-            if( auto ret = _expr.match(src) ){
-                _exist_fn();
-                return ret;
+            if( !src ){
+                return std::nullopt;
             }
-            _missing_fn();
-            return std::nullopt;
+            const Tables& t = *_tables;
+            std::optional<const char*> longest;
+            if( t.nullable ){
+                longest = src;
+            }
+            uint64_t d = t.first & t.bytes[static_cast<unsigned char>(*src)];
+            while( d ){
+                ++src;
+                if( d & t.last ){
+                    longest = src;
+                }
+                d = step( d ) & t.bytes[static_cast<unsigned char>(*src)];
+            }
+            return longest;
         }
-        const Expr          _expr;
-        ExistCallbackFn     _exist_fn;
-        MissingCallbackFn   _missing_fn;
-    };
 
-    template< typename Expr >
-    requires std::derived_from<Expr,Pattern>
-    ExistCallback<Expr> cb( const Expr& expr, ExistCallbackFn exist_fn, MissingCallbackFn missing_fn=defaultMissingFn ){
-        return ExistCallback<Expr>( expr, exist_fn, missing_fn );
-    }
-    inline ExistCallback<Char> cb( const char c, ExistCallbackFn exist_fn, MissingCallbackFn missing_fn=defaultMissingFn ){
-        return ExistCallback<Char>( Char(c), exist_fn, missing_fn );
-    }
-    inline ExistCallback<Str> cb( const char* c, ExistCallbackFn exist_fn, MissingCallbackFn missing_fn=defaultMissingFn ){
-        return ExistCallback<Str>( Str(c), exist_fn, missing_fn );
-    }
+        size_t positions() const { return _tables->positions; }
+        bool shift_and() const { return _tables->shift; }
+
+        struct Tables {
+            uint64_t                             bytes[256] = {};   // positions labelled with each byte
+            uint64_t                             first = 0, last = 0;
+            bool                                 nullable = false, shift = false;
+            size_t                               positions = 0;
+            std::vector<std::array<uint64_t,256>> follow;          // follow sets by 8-position chunk
+        };
+
+        uint64_t step( uint64_t d ) const {
+            if( _tables->shift ){
+                return d << 1;
+            }
+            uint64_t next = 0;
+            for( size_t k=0; d; ++k, d >>= 8 ){
+                next |= _tables->follow[k][d & 255];
+            }
+            return next;
+        }
+
+        std::shared_ptr<const Tables> _tables;
+    };
+
+    namespace detail {
+        /**
+         * @brief NfaBuilder, parses a pattern and computes its Glushkov first, last and follow sets
+         * Each expression is built straight from the text, so bounded repeats rebuild the repeated
+         * text to get fresh positions.
+         */
+        class NfaBuilder {
+            public:
+            struct Info {
+                uint64_t first = 0, last = 0;
+                bool     nullable = true;
+            };
+
+            NfaBuilder( std::string_view pattern ) : _pattern{pattern} {}
+
+            std::shared_ptr<const Nfa::Tables> build(){
+                _tables = std::make_shared<Nfa::Tables>();
+                const Info info = alternation();
+                if( _pos != _pattern.size() ){
+                    fail( "unbalanced ')'" );
+                }
+                Nfa::Tables& t = *_tables;
+                t.first     = info.first;
+                t.last      = info.last;
+                t.nullable  = info.nullable;
+                t.positions = _follow.size();
+
+                // a plain sequence of atoms only ever moves to the next position
+                t.shift = t.first == 1 && !t.nullable;
+                for( size_t i=0; i<_follow.size() && t.shift; ++i ){
+                    t.shift = _follow[i] == (i+1 < _follow.size() ? uint64_t(1) << (i+1) : 0);
+                }
+                if( !t.shift ){
+                    t.follow.resize( (_follow.size()+7)/8 );
+                    for( size_t k=0; k<t.follow.size(); ++k ){
+                        for( unsigned x=1; x<256; ++x ){
+                            const unsigned low = std::countr_zero( x );
+                            const size_t   i   = 8*k+low;
+                            t.follow[k][x] = t.follow[k][x & (x-1)] | (i < _follow.size() ? _follow[i] : 0);
+                        }
+                    }
+                }
+                return _tables;
+            }
+
+            private:
+            Info alternation(){
+                Info info = sequence();
+                while( peek() == '|' ){
+                    ++_pos;
+                    const Info next = sequence();
+                    info = { info.first | next.first, info.last | next.last, info.nullable || next.nullable };
+                }
+                return info;
+            }
+
+            Info sequence(){
+                Info info;
+                while( _pos < _pattern.size() && peek() != '|' && peek() != ')' ){
+                    info = concat( info, repeat() );
+                }
+                return info;
+            }
+
+            Info concat( const Info& a, const Info& b ){
+                link( a.last, b.first );
+                return { a.first | (a.nullable ? b.first : 0), b.last | (b.nullable ? a.last : 0), a.nullable && b.nullable };
+            }
+
+            void quantify( Info& info, char q ){
+                if( q != '?' ){
+                    link( info.last, info.first );
+                }
+                info.nullable = info.nullable || q != '+';
+            }
+
+            Info repeat(){
+                const size_t start = _pos;
+                Info info = atom();
+                std::string applied;    // quantifiers applied before a bounded repeat, e.g. the '*' of a*{2}
+                bool repeated = false;
+                while( true ){
+                    const char q = peek();
+                    if( q == '*' || q == '+' || q == '?' ){
+                        ++_pos;
+                        quantify( info, q );
+                        if( !repeated ){
+                            applied += q;
+                        }
+                    } else if( q == '{' && !repeated ){
+                        ++_pos;
+                        const size_t m = number();
+                        size_t n = m;
+                        bool unbounded = false;
+                        if( peek() == ',' ){
+                            ++_pos;
+                            unbounded = peek() == '}';
+                            if( !unbounded ){
+                                n = number();
+                            }
+                        }
+                        if( peek() != '}' || n < m ){
+                            fail( "malformed repeat" );
+                        }
+                        const size_t after = ++_pos;
+
+                        // x{m,n} is m copies of x and n-m optional ones, x{m,} ends in a starred copy;
+                        // the atom just parsed is the first copy and the others are rebuilt from its text,
+                        // with the quantifiers already applied to the first one
+                        const size_t count = unbounded ? std::max<size_t>( m, 1 ) : n;
+                        std::vector<Info> copies{ info };
+                        for( size_t i=1; i<count; ++i ){
+                            _pos = start;
+                            Info copy = atom();
+                            for( const char a : applied ){
+                                quantify( copy, a );
+                            }
+                            copies.push_back( copy );
+                        }
+                        _pos = after;
+                        for( size_t i=m; i<count; ++i ){
+                            copies[i].nullable = true;
+                        }
+                        if( unbounded ){
+                            link( copies.back().last, copies.back().first );
+                        }
+                        info = Info{};
+                        for( size_t i=0; i<count; ++i ){
+                            info = concat( info, copies[i] );
+                        }
+                        repeated = true;
+                    } else {
+                        return info;
+                    }
+                }
+            }
+
+            Info atom(){
+                if( _pos >= _pattern.size() ){
+                    fail( "unexpected end of pattern" );
+                }
+                const char c = _pattern[_pos++];
+                if( c == '(' ){
+                    const Info info = alternation();
+                    if( peek() != ')' ){
+                        fail( "missing ')'" );
+                    }
+                    ++_pos;
+                    return info;
+                }
+                std::array<bool,256> set{};
+                if( c == '.' ){
+                    set.fill( true );
+                } else if( c == '[' ){
+                    const bool negate = peek() == '^';
+                    if( negate ){
+                        ++_pos;
+                    }
+                    bool first = true;
+                    while( _pos < _pattern.size() && (_pattern[_pos] != ']' || first) ){
+                        first = false;
+                        std::array<bool,256> item{};
+                        const int lo = byte( item );
+                        if( lo >= 0 && peek() == '-' && _pos+1 < _pattern.size() && _pattern[_pos+1] != ']' ){
+                            ++_pos;
+                            std::array<bool,256> unused{};
+                            const int hi = byte( unused );
+                            if( hi < lo ){
+                                fail( "malformed class range" );
+                            }
+                            for( int b=lo; b<=hi; ++b ){
+                                item[b] = true;
+                            }
+                        }
+                        for( int b=0; b<256; ++b ){
+                            set[b] = set[b] || item[b];
+                        }
+                    }
+                    if( peek() != ']' ){
+                        fail( "missing ']'" );
+                    }
+                    ++_pos;
+                    if( negate ){
+                        for( bool& b : set ){
+                            b = !b;
+                        }
+                    }
+                } else if( c == '*' || c == '+' || c == '?' || c == '{' || c == ')' || c == '|' ){
+                    fail( "misplaced operator" );
+                } else {
+                    --_pos;
+                    byte( set );
+                }
+                set[0] = false;
+
+                if( _follow.size() == Nfa::max_positions ){
+                    fail( "more than 64 positions" );
+                }
+                const uint64_t bit = uint64_t(1) << _follow.size();
+                _follow.push_back( 0 );
+                for( int b=0; b<256; ++b ){
+                    if( set[b] ){
+                        _tables->bytes[b] |= bit;
+                    }
+                }
+                return { bit, bit, false };
+            }
+
+            // adds one possibly escaped byte or class escape to set, returning the byte or -1 for a class
+            int byte( std::array<bool,256>& set ){
+                if( _pos >= _pattern.size() ){
+                    fail( "unexpected end of pattern" );
+                }
+                unsigned char c = _pattern[_pos++];
+                if( c == '\\' ){
+                    if( _pos >= _pattern.size() ){
+                        fail( "unterminated escape" );
+                    }
+                    c = _pattern[_pos++];
+                    switch( c ){
+                        case 'd':
+                            for( int b='0'; b<='9'; ++b ) set[b] = true;
+                            return -1;
+                        case 'w':
+                            for( int b=0; b<256; ++b ) set[b] = std::isalnum(b) || b == '_';
+                            return -1;
+                        case 's':
+                            for( char b : std::string_view(" \t\r\n\f\v") ) set[static_cast<unsigned char>(b)] = true;
+                            return -1;
+                        case 'n': c = '\n'; break;
+                        case 'r': c = '\r'; break;
+                        case 't': c = '\t'; break;
+                        case 'x': {
+                            int v = 0;
+                            for( int i=0; i<2; ++i ){
+                                const char h = _pos < _pattern.size() ? _pattern[_pos++] : 0;
+                                const int d = (h >= '0' && h <= '9') ? h-'0' : ((h|0x20) >= 'a' && (h|0x20) <= 'f') ? (h|0x20)-'a'+10 : -1;
+                                if( d < 0 ){
+                                    fail( "malformed \\x escape" );
+                                }
+                                v = v*16+d;
+                            }
+                            c = static_cast<unsigned char>(v);
+                            break;
+                        }
+                        default: break;
+                    }
+                }
+                set[c] = true;
+                return c;
+            }
+
+            size_t number(){
+                size_t n = 0;
+                const size_t start = _pos;
+                while( _pos < _pattern.size() && _pattern[_pos] >= '0' && _pattern[_pos] <= '9' && n <= Nfa::max_positions ){
+                    n = n*10 + (_pattern[_pos++]-'0');
+                }
+                if( _pos == start || n > Nfa::max_positions ){
+                    fail( "malformed repeat" );
+                }
+                return n;
+            }
+
+            void link( uint64_t from, uint64_t to ){
+                for( ; from; from &= from-1 ){
+                    _follow[std::countr_zero( from )] |= to;
+                }
+            }
+
+            char peek() const {
+                return _pos < _pattern.size() ? _pattern[_pos] : '\0';
+            }
+
+            [[noreturn]] void fail( const char* what ) const {
+                throw std::runtime_error( std::string("Error: ")+what+" in nfa pattern." );
+            }
+
+            std::string_view                _pattern;
+            size_t                          _pos = 0;
+            std::shared_ptr<Nfa::Tables>    _tables;
+            std::vector<uint64_t>           _follow;
+        };
+    }
+
+    inline Nfa::Nfa( std::string_view pattern ) : _tables{ detail::NfaBuilder( pattern ).build() } {}
+
+    inline Nfa nfa( std::string_view pattern ){ return Nfa( pattern ); }
+
+    /**
+     * @brief AnyRule, type-erased copy of any grammar, e.g. to declare a rule in a header
+     * and define it in another translation unit, or to keep rules in containers
+     * Rules of up to buffer_size bytes are stored inline, larger ones on the heap. Matching costs
+     * one virtual call into the stored rule, whose body stays fully static.
+     */
+    class AnyRule final : public Pattern {
+        public:
+        static constexpr size_t buffer_size = 64;
+
+        AnyRule() = default;
+
+        template< typename Expr >
+        requires std::derived_from<Expr,Pattern> && (!std::same_as<Expr,AnyRule>)
+        AnyRule( const Expr& expr ) : _ops{ &ops<Expr> } {
+            _rule = _ops->copy( &expr, _buffer );
+        }
+
+        AnyRule( const AnyRule& other ) : _ops{other._ops} {
+            _rule = _ops ? _ops->copy( other._rule, _buffer ) : nullptr;
+        }
+
+        AnyRule( AnyRule&& other ) noexcept {
+            take( other );
+        }
+
+        AnyRule& operator=( const AnyRule& other ){
+            if( this != &other ){
+                reset();
+                _ops  = other._ops;
+                _rule = _ops ? _ops->copy( other._rule, _buffer ) : nullptr;
+            }
+            return *this;
+        }
+
+        AnyRule& operator=( AnyRule&& other ) noexcept {
+            if( this != &other ){
+                reset();
+                take( other );
+            }
+            return *this;
+        }
+
+        ~AnyRule(){
+            reset();
+        }
+
+        // an empty rule never matches
+        std::optional<const char*> match( const char* src ) const override {
+            if( _rule ){
+                return _rule->match( src );
+            }
+            return std::nullopt;
+        }
+
+        bool empty() const { return !_rule; }
+
+        // validator_of the stored rule, type-erased in turn
+        AnyRule validator() const {
+            AnyRule validator;
+            if( _ops ){
+                _ops->validator( _rule, validator );
+            }
+            return validator;
+        }
+
+        private:
+        struct Ops {
+            const Pattern* (*copy)( const Pattern*, void* );
+            const Pattern* (*move)( const Pattern*, void* ) noexcept;
+            void           (*destroy)( const Pattern* );
+            void           (*validator)( const Pattern*, AnyRule& );
+        };
+
+        // rules stored inline must move without throwing so that moving an AnyRule cannot throw
+        template< typename Expr >
+        static constexpr bool fits = sizeof(Expr) <= buffer_size && alignof(Expr) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<Expr>;
+
+        template< typename Expr, bool Validator >
+        void emplace( const Expr& expr ){
+            reset();
+            _rule = ops<Expr,Validator>.copy( &expr, _buffer );
+            _ops  = &ops<Expr,Validator>;
+        }
+
+        // rules that already are validators are their own validator, which keeps instantiations finite
+        template< typename Expr, bool Validator=false >
+        static constexpr Ops ops{
+            []( const Pattern* src, void* buffer ) -> const Pattern* {
+                const Expr& expr = *static_cast<const Expr*>( src );
+                if constexpr ( fits<Expr> ){
+                    return new (buffer) Expr( expr );
+                } else {
+                    void* memory = ::operator new( sizeof(Expr), std::align_val_t{alignof(Expr)} );
+                    try {
+                        return new (memory) Expr( expr );
+                    } catch( ... ){
+                        ::operator delete( memory, std::align_val_t{alignof(Expr)} );
+                        throw;
+                    }
+                }
+            },
+            []( const Pattern* src, void* buffer ) noexcept -> const Pattern* {
+                if constexpr ( fits<Expr> ){
+                    return new (buffer) Expr( std::move( *const_cast<Expr*>( static_cast<const Expr*>( src ) ) ) );
+                } else {
+                    return src;
+                }
+            },
+            // destroys through the concrete type, heap-stored rules were placed in raw storage
+            []( const Pattern* rule ){
+                Expr* expr = const_cast<Expr*>( static_cast<const Expr*>( rule ) );
+                expr->~Expr();
+                if constexpr ( !fits<Expr> ){
+                    ::operator delete( static_cast<void*>( expr ), std::align_val_t{alignof(Expr)} );
+                }
+            },
+            []( const Pattern* rule, AnyRule& out ){
+                const Expr& expr = *static_cast<const Expr*>( rule );
+                if constexpr ( Validator ){
+                    out.emplace<Expr,true>( expr );
+                } else {
+                    const auto validator = validator_of( expr );
+                    out.emplace<std::remove_cvref_t<decltype(validator)>,true>( validator );
+                }
+            }
+        };
+
+        bool inline_stored() const {
+            const uintptr_t rule = reinterpret_cast<uintptr_t>(_rule), buffer = reinterpret_cast<uintptr_t>(_buffer);
+            return rule >= buffer && rule < buffer+buffer_size;
+        }
+
+        void reset(){
+            if( _ops ){
+                _ops->destroy( _rule );
+            }
+            _ops  = nullptr;
+            _rule = nullptr;
+        }
+
+        // heap-stored rules are stolen, inline ones are moved
+        void take( AnyRule& other ) noexcept {
+            _ops = other._ops;
+            if( !_ops ){
+                _rule = nullptr;
+            } else if( other.inline_stored() ){
+                _rule = _ops->move( other._rule, _buffer );
+            } else {
+                _rule = std::exchange( other._rule, nullptr );
+                other._ops = nullptr;
+            }
+        }
+
+        const Ops*     _ops  = nullptr;
+        const Pattern* _rule = nullptr;
+        alignas(std::max_align_t) std::byte _buffer[buffer_size];
+    };
+
+    /**
+     * @brief GrammarHandle, publishes new versions of a grammar while other threads keep matching
+     * Each matching thread registers a Reader once; Reader::read() is then wait-free and pins
+     * the current version until the returned guard is destroyed. Retired versions are freed by
+     * publish() or collect() once every reader that could hold them has moved on (epoch-based
+     * reclamation). Registration, publishing and collection take a mutex, reads never do.
+     */
+    template< typename Rule=AnyRule >
+    class GrammarHandle {
+        struct Version {
+            Rule     rule;
+            uint64_t retired = 0;
+        };
+
+        struct Slot {
+            alignas(64) std::atomic<uint64_t> active{0};  // epoch announced by the reader, 0 when idle
+            bool owned = false;
+        };
+
+        public:
+        GrammarHandle( const Rule& rule ) : _current{ new Version{ rule } } {}
+        GrammarHandle( const GrammarHandle& ) = delete;
+        GrammarHandle& operator=( const GrammarHandle& ) = delete;
+
+        // all readers must have been destroyed
+        ~GrammarHandle(){
+            delete _current.load();
+        }
+
+        class Reader;
+
+        /**
+         * @brief Guard, keeps a grammar version alive while in scope
+         */
+        class Guard {
+            public:
+            Guard( const Guard& ) = delete;
+            Guard& operator=( const Guard& ) = delete;
+            ~Guard(){
+                if( --_reader._depth == 0 ){
+                    _reader._slot->active.store( 0, std::memory_order_release );
+                }
+            }
+            const Rule& rule() const { return _version->rule; }
+            const Rule* operator->() const { return &_version->rule; }
+            std::optional<const char*> match( const char* src ) const { return _version->rule.match( src ); }
+
+            private:
+            friend class Reader;
+            Guard( Reader& reader, const Version* version ) : _reader{reader}, _version{version} {}
+            Reader&        _reader;
+            const Version* _version;
+        };
+
+        /**
+         * @brief Reader, a registration for one thread, destroy it before the handle
+         */
+        class Reader {
+            public:
+            Reader( const Reader& ) = delete;
+            Reader& operator=( const Reader& ) = delete;
+            ~Reader(){
+                std::lock_guard lock( _handle._mutex );
+                _slot->owned = false;
+            }
+
+            // wait-free: announce the epoch, then load the version it protects
+            Guard read(){
+                if( _depth++ == 0 ){
+                    _slot->active.store( _handle._epoch.load() );
+                }
+                return Guard( *this, _handle._current.load() );
+            }
+
+            std::optional<const char*> match( const char* src ){
+                return read().match( src );
+            }
+
+            private:
+            friend class GrammarHandle;
+            Reader( GrammarHandle& handle, Slot* slot ) : _handle{handle}, _slot{slot} {}
+            GrammarHandle& _handle;
+            Slot*          _slot;
+            size_t         _depth = 0;
+        };
+
+        Reader reader(){
+            std::lock_guard lock( _mutex );
+            for( Slot& slot : _slots ){
+                if( !slot.owned ){
+                    slot.owned = true;
+                    return Reader( *this, &slot );
+                }
+            }
+            Slot& slot = _slots.emplace_back();
+            slot.owned = true;
+            return Reader( *this, &slot );
+        }
+
+        // swaps in a new version, readers pick it up on their next read()
+        void publish( const Rule& rule ){
+            auto next = std::make_unique<Version>( Version{ rule } );
+            std::lock_guard lock( _mutex );
+            std::unique_ptr<Version> old( _current.exchange( next.release() ) );
+            old->retired = _epoch.fetch_add( 1 )+1;
+            _retired.push_back( std::move(old) );
+            reclaim();
+        }
+
+        // frees retired versions that no reader can still hold, returns how many remain
+        size_t collect(){
+            std::lock_guard lock( _mutex );
+            reclaim();
+            return _retired.size();
+        }
+
+        private:
+        // a reader announcing an epoch older than a version's retirement may still hold it
+        void reclaim(){
+            uint64_t oldest = UINT64_MAX;
+            for( const Slot& slot : _slots ){
+                if( const uint64_t e = slot.active.load() ){
+                    oldest = std::min( oldest, e );
+                }
+            }
+            std::erase_if( _retired, [oldest]( const std::unique_ptr<Version>& v ){ return v->retired <= oldest; } );
+        }
+
+        std::atomic<Version*>                 _current;
+        std::atomic<uint64_t>                 _epoch{1};
+        std::mutex                            _mutex;
+        std::deque<Slot>                      _slots;
+        std::vector<std::unique_ptr<Version>> _retired;
+    };
+
+    // called whenever a given token matches
+    using ExistCallbackFn   = std::function<void()>;
+    using MissingCallbackFn = std::function<void()>; 
+
+    inline void defaultExistFn(){}
+    inline void defaultMissingFn(){}
+
+    template< typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    struct ExistCallback : public Pattern {
+        ExistCallback( const Expr& expr, ExistCallbackFn exist_fn, MissingCallbackFn missing_fn ) : _expr{expr}, _exist_fn{exist_fn}, _missing_fn{missing_fn} {}
+        std::optional<const char*> match( const char* src ) const override {
+            if( auto ret = _expr.match(src) ){
+                _exist_fn();
+                return ret;
+            }
+            _missing_fn();
+            return std::nullopt;
+        }
+        const Expr          _expr;
+        ExistCallbackFn     _exist_fn;
+        MissingCallbackFn   _missing_fn;
+    };
+
+    template< typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    ExistCallback<Expr> cb( const Expr& expr, ExistCallbackFn exist_fn, MissingCallbackFn missing_fn=defaultMissingFn ){
+        return ExistCallback<Expr>( expr, exist_fn, missing_fn );
+    }
+    inline ExistCallback<Char> cb( const char c, ExistCallbackFn exist_fn, MissingCallbackFn missing_fn=defaultMissingFn ){
+        return ExistCallback<Char>( Char(c), exist_fn, missing_fn );
+    }
+    inline ExistCallback<Str> cb( const char* c, ExistCallbackFn exist_fn, MissingCallbackFn missing_fn=defaultMissingFn ){
+        return ExistCallback<Str>( Str(c), exist_fn, missing_fn );
+    }
 
     // zero-allocation callback that also provides the matching string
     using RangeCallbackFn = std::function<void(const char*,const char*)>;
 
-    template< typename Expr >
-    requires std::derived_from<Expr,Pattern>
-    struct RangeCallback : public Pattern {
-        RangeCallback( const Expr& expr, RangeCallbackFn exist_fn, MissingCallbackFn missing_fn ) : _expr{expr}, _exist_fn{exist_fn}, _missing_fn{missing_fn} {}
+    template< typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    struct RangeCallback : public Pattern {
+        RangeCallback( const Expr& expr, RangeCallbackFn exist_fn, MissingCallbackFn missing_fn ) : _expr{expr}, _exist_fn{exist_fn}, _missing_fn{missing_fn} {}
+        std::optional<const char*> match( const char* src ) const override {
+            if( auto ret = _expr.match(src) ){
+                _exist_fn(src,*ret+1);
+                return ret;
+            }
+            _missing_fn();
+            return std::nullopt;
+        }
+        const Expr        _expr;
+        RangeCallbackFn   _exist_fn;
+        MissingCallbackFn _missing_fn;
+    };
+
+    template< typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    RangeCallback<Expr> cb( const Expr& expr, RangeCallbackFn exist_fn, MissingCallbackFn missing_fn=defaultMissingFn ){
+        return RangeCallback( expr, exist_fn, missing_fn );
+    }
+
+    // callback that provides the matching string, String may be a std::pmr::string
+    // so that the copies are made from a caller-provided memory resource
+    using StringCallbackFn    = std::function<void(const std::string&)>;
+    using PmrStringCallbackFn = std::function<void(const std::pmr::string&)>;
+
+    template< typename Expr, typename String=std::string >
+    requires std::derived_from<Expr,Pattern>
+    struct StringCallback : public Pattern {
+        using ExistFn = std::function<void(const String&)>;
+        StringCallback( const Expr& expr, ExistFn exist_fn, MissingCallbackFn missing_fn, typename String::allocator_type alloc={} ) : _expr{expr}, _exist_fn{exist_fn}, _missing_fn{missing_fn}, _alloc{alloc} {}
+        std::optional<const char*> match( const char* src ) const override {
+            if( auto ret = _expr.match(src) ){
+                const String tmp( src, *ret, _alloc );
+                _exist_fn(tmp);
+                return ret;
+            }
+            _missing_fn();
+            return std::nullopt;
+        }
+        const Expr        _expr;
+        ExistFn           _exist_fn;
+        MissingCallbackFn _missing_fn;
+        typename String::allocator_type _alloc;
+    };
+
+    template< typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    StringCallback<Expr> cb( const Expr& expr, StringCallbackFn exist_fn, MissingCallbackFn missing_fn=defaultMissingFn ){
+        return StringCallback<Expr>( expr, exist_fn, missing_fn );
+    }
+
+    template< typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    StringCallback<Expr,std::pmr::string> cb( const Expr& expr, std::pmr::memory_resource* resource, PmrStringCallbackFn exist_fn, MissingCallbackFn missing_fn=defaultMissingFn ){
+        return StringCallback<Expr,std::pmr::string>( expr, exist_fn, missing_fn, resource );
+    }
+
+    // left-factoring of ordered choice: (P A) / (P B) is matched as P (A / B) when P is pure,
+    // since PEG matching is deterministic and P then gives the same result for both alternatives
+    namespace detail {
+        // value equality for stateless nodes, nodes without an overload are never factored
+        template< typename T >
+        bool same( const T&, const T& ){ return false; }
+        inline bool same( const Eps&, const Eps& ){ return true; }
+        inline bool same( const Any&, const Any& ){ return true; }
+        inline bool same( const Char& a, const Char& b ){ return a._c == b._c; }
+        inline bool same( const Range& a, const Range& b ){ return a._lo == b._lo && a._hi == b._hi; }
+        inline bool same( const Str& a, const Str& b ){ return std::strcmp( a._seq, b._seq ) == 0; }
+        template< FixedString S >
+        bool same( const Lit<S>&, const Lit<S>& ){ return true; }
+
+        // composites recurse, so all of them are declared before any is defined
+        template< typename Expr > bool same( const Check<Expr>&, const Check<Expr>& );
+        template< typename Expr > bool same( const Not<Expr>&, const Not<Expr>& );
+        template< typename Expr > bool same( const ZeroPlus<Expr>&, const ZeroPlus<Expr>& );
+        template< typename Expr > bool same( const Until<Expr>&, const Until<Expr>& );
+        template< typename Left, typename Right > bool same( const Or<Left,Right>&, const Or<Left,Right>& );
+        template< typename Left, typename Right > bool same( const And<Left,Right>&, const And<Left,Right>& );
+
+        template< typename Expr >
+        bool same( const Check<Expr>& a, const Check<Expr>& b ){ return same( a._expr, b._expr ); }
+        template< typename Expr >
+        bool same( const Not<Expr>& a, const Not<Expr>& b ){ return same( a._expr, b._expr ); }
+        template< typename Expr >
+        bool same( const ZeroPlus<Expr>& a, const ZeroPlus<Expr>& b ){ return same( a._expr, b._expr ); }
+        template< typename Expr >
+        bool same( const Until<Expr>& a, const Until<Expr>& b ){ return same( a._expr, b._expr ); }
+        template< typename Left, typename Right >
+        bool same( const Or<Left,Right>& a, const Or<Left,Right>& b ){ return same( a._left, b._left ) && same( a._right, b._right ); }
+        template< typename Left, typename Right >
+        bool same( const And<Left,Right>& a, const And<Left,Right>& b ){ return same( a._left, b._left ) && same( a._right, b._right ); }
+
+        // a sequence flattened into pointers to its elements, regardless of how it was parenthesized
+        template< typename Expr >
+        auto spine( const Expr& e ){ return std::tuple<const Expr*>( &e ); }
+        template< typename Left, typename Right >
+        auto spine( const And<Left,Right>& e ){ return std::tuple_cat( spine( e._left ), spine( e._right ) ); }
+
+        // alternatives that can be factored: sequences, optionally wrapped in a callback
+        template< typename T >
+        struct factorable : std::false_type {};
+        template< typename Left, typename Right >
+        struct factorable< And<Left,Right> > : std::true_type {};
+        template< typename Expr >
+        struct factorable< ExistCallback<Expr> > : std::true_type {};
+        template< typename Expr >
+        struct factorable< RangeCallback<Expr> > : std::true_type {};
+        template< typename Expr, typename String >
+        struct factorable< StringCallback<Expr,String> > : std::true_type {};
+
+        // composites undo what their children do, user functions and type-erased rules may do anything
+        template< typename Expr >
+        struct undoable< Check<Expr> > : undoable<Expr> {};
+        template< typename Expr >
+        struct undoable< Not<Expr> > : undoable<Expr> {};
+        template< typename Expr >
+        struct undoable< ZeroPlus<Expr> > : undoable<Expr> {};
+        template< typename Expr >
+        struct undoable< Until<Expr> > : undoable<Expr> {};
+        template< typename Left, typename Right >
+        struct undoable< Or<Left,Right> > : std::bool_constant< undoable<Left>::value || undoable<Right>::value > {};
+        template< typename Left, typename Right >
+        struct undoable< And<Left,Right> > : std::bool_constant< undoable<Left>::value || undoable<Right>::value > {};
+        template< typename Expr >
+        struct undoable< ExistCallback<Expr> > : undoable<Expr> {};
+        template< typename Expr >
+        struct undoable< RangeCallback<Expr> > : undoable<Expr> {};
+        template< typename Expr, typename String >
+        struct undoable< StringCallback<Expr,String> > : undoable<Expr> {};
+        template<> struct undoable<User>    : std::true_type {};
+        template<> struct undoable<AnyRule> : std::true_type {};
+
+        template< typename Expr >
+        const Expr& body( const Expr& e ){ return e; }
+        template< typename Expr >
+        const Expr& body( const ExistCallback<Expr>& e ){ return e._expr; }
+        template< typename Expr >
+        const Expr& body( const RangeCallback<Expr>& e ){ return e._expr; }
+        template< typename Expr, typename String >
+        const Expr& body( const StringCallback<Expr,String>& e ){ return e._expr; }
+
+        // runs the callback of an alternative on the result of its body
+        template< typename Expr >
+        std::optional<const char*> finish( const Expr&, const char*, std::optional<const char*> ret ){ return ret; }
+        template< typename Expr >
+        std::optional<const char*> finish( const ExistCallback<Expr>& e, const char*, std::optional<const char*> ret ){
+            ret ? e._exist_fn() : e._missing_fn();
+            return ret;
+        }
+        template< typename Expr >
+        std::optional<const char*> finish( const RangeCallback<Expr>& e, const char* src, std::optional<const char*> ret ){
+            ret ? e._exist_fn( src, *ret+1 ) : e._missing_fn();
+            return ret;
+        }
+        template< typename Expr, typename String >
+        std::optional<const char*> finish( const StringCallback<Expr,String>& e, const char* src, std::optional<const char*> ret ){
+            if( ret ){
+                const String tmp( src, *ret, e._alloc );
+                e._exist_fn( tmp );
+            } else {
+                e._missing_fn();
+            }
+            return ret;
+        }
+
+        // number of leading elements shared by two alternatives
+        template< typename Left, typename Right >
+        size_t shared_prefix( const Left& left, const Right& right ){
+            const auto l = spine( body( left ) );
+            const auto r = spine( body( right ) );
+            constexpr size_t n = std::min( std::tuple_size_v<decltype(l)>, std::tuple_size_v<decltype(r)> );
+            size_t k = 0;
+            bool equal = true;
+            [&]<size_t... I>( std::index_sequence<I...> ){
+                auto step = [&]( const auto* a, const auto* b ){
+                    if constexpr ( std::is_same_v<decltype(a),decltype(b)> ){
+                        equal = equal && same( *a, *b );
+                    } else {
+                        equal = false;
+                    }
+                    k += equal;
+                };
+                ( step( std::get<I>(l), std::get<I>(r) ), ... );
+            }( std::make_index_sequence<n>() );
+            return k;
+        }
+
+        // matches elements [from,to) of a spine in sequence, calling each node's own match non-virtually
+        template< typename Tuple >
+        std::optional<const char*> match_elements( const Tuple& elements, size_t from, size_t to, const char* src ){
+            std::optional<const char*> ret = src;
+            size_t i = 0;
+            std::apply( [&]( const auto*... e ){
+                auto step = [&]( const auto* e ){
+                    using E = std::remove_cvref_t<decltype(*e)>;
+                    if( ret && i >= from && i < to ){
+                        ret = e->E::match( *ret );
+                    }
+                    ++i;
+                };
+                ( step( e ), ... );
+            }, elements );
+            return ret;
+        }
+
+        // matches left / right after matching their first k elements once
+        template< typename Left, typename Right >
+        std::optional<const char*> match_factored( const Left& left, const Right& right, size_t k, const char* src ){
+            const auto l = spine( body( left ) );
+            const auto r = spine( body( right ) );
+            const auto prefix = match_elements( l, 0, k, src );
+            if( !prefix ){
+                finish( left, src, std::nullopt );
+                return finish( right, src, std::nullopt );
+            }
+            // the shared prefix has no side effects, those of the left suffix are taken back
+            std::optional<ChoicePoint> choice;
+            if constexpr ( undoable<Left>::value ){
+                choice.emplace();
+            }
+            if( auto ret = finish( left, src, match_elements( l, k, std::tuple_size_v<decltype(l)>, *prefix ) ) ){
+                return ret;
+            }
+            if( choice ){
+                choice->unwind();
+            }
+            return finish( right, src, match_elements( r, k, std::tuple_size_v<decltype(r)>, *prefix ) );
+        }
+    }
+
+    /**
+     * @brief Or of two sequences, matches a shared pure prefix once before trying the alternatives
+     */
+    template< typename Left, typename Right >
+    requires std::derived_from<Left,Pattern> && std::derived_from<Right,Pattern> && detail::factorable<Left>::value && detail::factorable<Right>::value
+    struct Or<Left,Right> : public Pattern {
+        Or( const Left& left, const Right& right ) : _left{left}, _right{right}, _shared{ detail::shared_prefix( left, right ) } {}
+        std::optional<const char*> match( const char* src ) const override {
+            if( _shared ){
+                return detail::match_factored( _left, _right, _shared, src );
+            }
+            if( auto res = detail::attempt( _left, src ) ){
+                return res;
+            }
+            return _right.match(src);
+        }
+        const Left   _left;
+        const Right  _right;
+        const size_t _shared;
+    };
+
+    /**
+     * @brief Or of a choice and a sequence, (A / B) / C is matched as A / (B C factored)
+     */
+    template< typename A, typename B, typename Right >
+    requires detail::factorable<B>::value && detail::factorable<Right>::value
+    struct Or<Or<A,B>,Right> : public Pattern {
+        Or( const Or<A,B>& left, const Right& right ) : _left{left}, _right{right}, _shared{ detail::shared_prefix( left._right, right ) } {}
+        std::optional<const char*> match( const char* src ) const override {
+            if( !_shared ){
+                if( auto res = detail::attempt( _left, src ) ){
+                    return res;
+                }
+                return _right.match(src);
+            }
+            if( auto res = detail::attempt( _left._left, src ) ){
+                return res;
+            }
+            return detail::match_factored( _left._right, _right, _shared, src );
+        }
+        const Or<A,B> _left;
+        const Right   _right;
+        const size_t  _shared;
+    };
+
+    /**
+     * @brief And of a lookahead and the same expression, check(x) & x, matches x only once
+     * Fusion is automatic when x is stateless and both copies compare equal; peek_then(x) requests
+     * it explicitly for any x, running its side effects once rather than twice.
+     */
+    template< typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    struct And<Check<Expr>,Expr> : public Pattern {
+        And( const Check<Expr>& left, const Expr& right, bool fuse=false ) : _left{left}, _right{right}, _fused{ fuse || detail::same( left._expr, right ) } {}
+        std::optional<const char*> match( const char* src ) const override {
+            if( _fused ){
+                return _right.match(src);
+            }
+            if( auto tmp = _left.match(src) ){
+                return _right.match(*tmp);
+            }
+            return std::nullopt;
+        }
+        const Check<Expr> _left;
+        const Expr        _right;
+        const bool        _fused;
+    };
+
+    // the same fusion at the end of a longer sequence, e.g. "key" & check(delim) & delim
+    template< typename Left, typename Expr >
+    requires std::derived_from<Left,Pattern> && std::derived_from<Expr,Pattern>
+    struct And<And<Left,Check<Expr>>,Expr> : public Pattern {
+        And( const And<Left,Check<Expr>>& left, const Expr& right ) : _left{left}, _right{right}, _fused{ detail::same( left._right._expr, right ) } {}
+        std::optional<const char*> match( const char* src ) const override {
+            if( auto tmp = _fused ? _left._left.match(src) : _left.match(src) ){
+                return _right.match(*tmp);
+            }
+            return std::nullopt;
+        }
+        const And<Left,Check<Expr>> _left;
+        const Expr                  _right;
+        const bool                  _fused;
+    };
+
+    template< typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    And<Check<Expr>,Expr> peek_then( const Expr& expr ){
+        return And<Check<Expr>,Expr>( check( expr ), expr, true );
+    }
+
+    // columnar extraction, captures are appended directly to Arrow-style column
+    // buffers so that records never materialize as structs or std::strings
+
+    /**
+     * @brief Packed LSB-first validity bitmap shared by the column types
+     */
+    struct ValidityBitmap {
+        ValidityBitmap( std::pmr::memory_resource* resource=std::pmr::get_default_resource() ) : _bits{resource} {}
+        void push( bool valid ){
+            if( _size % 8 == 0 ){
+                _bits.push_back(0);
+            }
+            if( valid ){
+                _bits.back() |= uint8_t(1u << (_size % 8));
+            } else {
+                ++_null_count;
+            }
+            ++_size;
+        }
+        bool valid( size_t i ) const {
+            return _bits[i/8] & (1u << (i % 8));
+        }
+        void truncate( size_t n ){
+            if( n >= _size ){
+                return;
+            }
+            while( _size > n ){
+                --_size;
+                if( !valid(_size) ){
+                    --_null_count;
+                }
+                _bits[_size/8] &= uint8_t(~(1u << (_size % 8)));
+            }
+            _bits.resize( (n+7)/8 );
+        }
+        std::pmr::vector<uint8_t> _bits;
+        size_t _size = 0;
+        size_t _null_count = 0;
+    };
+
+    /**
+     * @brief StringColumn, variable width column of int32 offsets into one contiguous byte buffer
+     */
+    struct StringColumn {
+        using value_type = std::string_view;
+        StringColumn( std::pmr::memory_resource* resource=std::pmr::get_default_resource() ) : _offsets(1,0,resource), _data{resource}, _validity{resource} {}
+        bool append( const char* begin, const char* end ){
+            _data.insert( _data.end(), begin, end );
+            _offsets.push_back( static_cast<int32_t>(_data.size()) );
+            _validity.push(true);
+            return true;
+        }
+        void append_null(){
+            _offsets.push_back( _offsets.back() );
+            _validity.push(false);
+        }
+        void truncate( size_t n ){
+            if( n >= size() ){
+                return;
+            }
+            _offsets.resize( n+1 );
+            _data.resize( _offsets.back() );
+            _validity.truncate( n );
+        }
+        size_t size() const { return _offsets.size()-1; }
+        std::string_view operator[]( size_t i ) const {
+            return std::string_view( _data.data()+_offsets[i], _offsets[i+1]-_offsets[i] );
+        }
+        std::pmr::vector<int32_t> _offsets;
+        std::pmr::vector<char>    _data;
+        ValidityBitmap            _validity;
+    };
+
+    /**
+     * @brief NumericColumn, fixed width column converting captures in place with std::from_chars
+     * Appending fails, and so does the enclosing match, if the whole capture does not convert.
+     */
+    template< typename T >
+    requires std::is_arithmetic_v<T>
+    struct NumericColumn {
+        using value_type = T;
+        NumericColumn( std::pmr::memory_resource* resource=std::pmr::get_default_resource() ) : _values{resource}, _validity{resource} {}
+        bool append( const char* begin, const char* end ){
+            T value{};
+            auto [ptr,ec] = std::from_chars( begin, end, value );
+            if( ec != std::errc() || ptr != end ){
+                return false;
+            }
+            _values.push_back( value );
+            _validity.push(true);
+            return true;
+        }
+        void append_null(){
+            _values.push_back( T{} );
+            _validity.push(false);
+        }
+        void truncate( size_t n ){
+            if( n >= size() ){
+                return;
+            }
+            _values.resize( n );
+            _validity.truncate( n );
+        }
+        size_t size() const { return _values.size(); }
+        T operator[]( size_t i ) const { return _values[i]; }
+        std::pmr::vector<T> _values;
+        ValidityBitmap      _validity;
+    };
+
+    /**
+     * @brief ColumnBatch, a fixed set of columns filled by Column nodes and committed by Row nodes
+     */
+    template< typename... Columns >
+    struct ColumnBatch {
+        ColumnBatch( std::pmr::memory_resource* resource=std::pmr::get_default_resource() ) : _columns{ Columns(resource)... } {}
+
+        template< size_t N >
+        auto& column(){ return std::get<N>(_columns); }
+
+        template< size_t N >
+        const auto& column() const { return std::get<N>(_columns); }
+
+        size_t rows() const { return _rows; }
+
+        // pads columns that received no value with nulls so that all columns have _rows entries,
+        // fails if a column received more than one value
+        bool commit_row(){
+            const size_t rows = _rows+1;
+            if( !std::apply( [rows]( const auto&... col ){ return ( (col.size() <= rows) && ... ); }, _columns ) ){
+                return false;
+            }
+            _rows = rows;
+            std::apply( [rows]( auto&... col ){ ( (col.size() < rows ? col.append_null() : void()), ... ); }, _columns );
+            return true;
+        }
+
+        void truncate( size_t n ){
+            _rows = std::min( _rows, n );
+            std::apply( [n]( auto&... col ){ ( col.truncate(n), ... ); }, _columns );
+        }
+
+        std::tuple<Columns...> _columns;
+        size_t _rows = 0;
+    };
+
+    /**
+     * @brief Column, appends the text matched by the expression to column N of a batch
+     */
+    template< size_t N, typename Batch, typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    struct Column : public Pattern {
+        Column( Batch& batch, const Expr& expr ) : _batch{batch}, _expr{expr} {}
+        std::optional<const char*> match( const char* src ) const override {
+            if( auto ret = _expr.match(src) ){
+                auto& col = _batch.template column<N>();
+                const size_t size = col.size();
+                if( col.append( src, *ret ) ){
+                    detail::journal.record( { &undo, &col, size, {} } );
+                    return ret;
+                }
+            }
+            return std::nullopt;
+        }
+        static void undo( const detail::Journal::Entry& e ){
+            static_cast<std::tuple_element_t<N,decltype(Batch::_columns)>*>( e.target )->truncate( e.size );
+        }
+        Batch&     _batch;
+        const Expr _expr;
+    };
+
+    template< size_t N, typename Batch, typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    Column<N,Batch,Expr> column( Batch& batch, const Expr& expr ){
+        return Column<N,Batch,Expr>( batch, expr );
+    }
+
+    /**
+     * @brief Row, commits the columns appended by the expression as one record, rolling them back on failure
+     * Values appended by alternatives that fail within the row are taken back at their choice point,
+     * and a row that fills a column twice fails.
+     */
+    template< typename Batch, typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    struct Row : public Pattern {
+        Row( Batch& batch, const Expr& expr ) : _batch{batch}, _expr{expr} {}
+        std::optional<const char*> match( const char* src ) const override {
+            const size_t rows = _batch.rows();
+            if( auto ret = _expr.match(src); ret && _batch.commit_row() ){
+                detail::journal.record( { &undo, &_batch, rows, {} } );
+                return ret;
+            }
+            _batch.truncate( rows );
+            return std::nullopt;
+        }
+        static void undo( const detail::Journal::Entry& e ){
+            static_cast<Batch*>( e.target )->truncate( e.size );
+        }
+        Batch&     _batch;
+        const Expr _expr;
+    };
+
+    namespace detail {
+        template< size_t N, typename Batch, typename Expr >
+        struct undoable< Column<N,Batch,Expr> > : std::true_type {};
+        template< typename Batch, typename Expr >
+        struct undoable< Row<Batch,Expr> > : std::true_type {};
+    }
+
+    template< typename Batch, typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    Row<Batch,Expr> row( Batch& batch, const Expr& expr ){
+        return Row<Batch,Expr>( batch, expr );
+    }
+
+    // schema-directed extraction, captures are converted in place into struct
+    // members named by member pointers, without intermediate strings or callbacks
+
+    /**
+     * @brief Keywords, specialize with a static `values` table of {name,enumerator} pairs to extract enums
+     */
+    template< typename Enum >
+    requires std::is_enum_v<Enum>
+    struct Keywords;
+
+    // conversions from matched text to member types, return false if the text does not convert
+    inline bool from_text( const char* begin, const char* end, std::string_view& out ){
+        out = std::string_view( begin, end-begin );
+        return true;
+    }
+
+    inline bool from_text( const char* begin, const char* end, std::string& out ){
+        out.assign( begin, end );
+        return true;
+    }
+
+    template< typename T >
+    requires std::is_arithmetic_v<T> && (!std::is_same_v<T,bool>)
+    bool from_text( const char* begin, const char* end, T& out ){
+        auto [ptr,ec] = std::from_chars( begin, end, out );
+        return ec == std::errc() && ptr == end;
+    }
+
+    template< typename Enum >
+    requires std::is_enum_v<Enum>
+    bool from_text( const char* begin, const char* end, Enum& out ){
+        const std::string_view text( begin, end-begin );
+        for( const auto& [name,value] : Keywords<Enum>::values ){
+            if( name == text ){
+                out = value;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template< typename MemberPtr >
+    struct member_pointer_traits;
+
+    template< typename Record, typename Value >
+    struct member_pointer_traits<Value Record::*> {
+        using record_type = Record;
+        using value_type  = Value;
+    };
+
+    /**
+     * @brief Field, converts the text matched by the expression into a member of a record
+     * The match fails if the text does not convert to the member type.
+     */
+    template< auto Member, typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    struct Field : public Pattern {
+        using Record = typename member_pointer_traits<decltype(Member)>::record_type;
+        Field( Record& record, const Expr& expr ) : _record{record}, _expr{expr} {}
+        std::optional<const char*> match( const char* src ) const override {
+            if( auto ret = _expr.match(src) ){
+                if( from_text( src, *ret, _record.*Member ) ){
+                    return ret;
+                }
+            }
+            return std::nullopt;
+        }
+        Record&    _record;
+        const Expr _expr;
+    };
+
+    template< auto Member, typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    Field<Member,Expr> field( typename member_pointer_traits<decltype(Member)>::record_type& record, const Expr& expr ){
+        return Field<Member,Expr>( record, expr );
+    }
+
+    /**
+     * @brief Binds a record to a member pointer, calling with an expression builds the Field node
+     */
+    template< auto Member >
+    struct FieldBinder {
+        using Record = typename member_pointer_traits<decltype(Member)>::record_type;
+
+        template< typename Expr >
+        requires std::derived_from<Expr,Pattern>
+        Field<Member,Expr> operator()( const Expr& expr ) const {
+            return Field<Member,Expr>( _record, expr );
+        }
+        Record& _record;
+    };
+
+    // auto [ts,status] = fields<&Record::ts,&Record::status>(record);
+    template< auto Member, auto... Members >
+    auto fields( typename member_pointer_traits<decltype(Member)>::record_type& record ){
+        return std::tuple{ FieldBinder<Member>{record}, FieldBinder<Members>{record}... };
+    }
+
+    // symbol stacks, backreferences to earlier captures for balanced tags, heredocs and similar
+
+    /**
+     * @brief SymbolStack, stack of source spans that choice points restore on backtracking
+     * Spans are kept in a small buffer (N inline, then heap). Pushes and pops made inside a choice
+     * point are journaled, so a failed alternative takes them back, including entries it popped.
+     */
+    template< size_t N=16 >
+    struct SymbolStack {
+        SymbolStack( std::pmr::memory_resource* resource=std::pmr::get_default_resource() ) : _overflow{resource} {}
+
+        void push( std::string_view span ){
+            put( span );
+            detail::journal.record( { &undo_push, this, 0, {} } );
+        }
+
+        bool pop(){
+            if( empty() ){
+                return false;
+            }
+            const std::string_view span = top();
+            --_size;
+            detail::journal.record( { &undo_pop, this, 0, span } );
+            return true;
+        }
+
+        bool empty() const { return _size == 0; }
+        size_t depth() const { return _size; }
+        std::string_view top() const { return _size <= N ? _inline[_size-1] : _overflow[_size-1-N]; }
+
+        void clear(){
+            _size = 0;
+            _overflow.clear();
+        }
+
+        void put( std::string_view span ){
+            if( _size < N ){
+                _inline[_size] = span;
+            } else {
+                _overflow.resize( _size-N );
+                _overflow.push_back( span );
+            }
+            ++_size;
+        }
+
+        static void undo_push( const detail::Journal::Entry& e ){
+            --static_cast<SymbolStack*>( e.target )->_size;
+        }
+        static void undo_pop( const detail::Journal::Entry& e ){
+            static_cast<SymbolStack*>( e.target )->put( e.span );
+        }
+
+        std::array<std::string_view,N>   _inline;
+        std::pmr::vector<std::string_view> _overflow;
+        size_t _size = 0;
+    };
+
+    /**
+     * @brief ThreadStack, stands in for a symbol stack in validators, each thread gets its own copy
+     * Handles made for the same stack share the per-thread copies, so a grammar using one stack in
+     * several nodes still sees a single stack. clear() empties the calling thread's copy.
+     */
+    template< typename Stack >
+    struct ThreadStack {
+        explicit ThreadStack( const Stack& stack ) : _id{&stack} {}
+
+        void push( std::string_view span ) const { local().push( span ); }
+        bool pop() const { return local().pop(); }
+        bool empty() const { return local().empty(); }
+        size_t depth() const { return local().depth(); }
+        std::string_view top() const { return local().top(); }
+        void clear() const { local().clear(); }
+
+        Stack& local() const {
+            thread_local std::map<const Stack*,Stack> stacks;
+            return stacks.try_emplace( _id ).first->second;
+        }
+
+        const Stack* _id;
+    };
+
+    namespace detail {
+        // symbol-stack nodes hold stacks by reference and thread stacks, which are handles, by value
+        template< typename Stack >
+        struct stack_ref_of { using type = Stack&; };
+        template< typename Stack >
+        struct stack_ref_of< ThreadStack<Stack> > { using type = ThreadStack<Stack>; };
+        template< typename Stack >
+        using stack_ref = typename stack_ref_of<Stack>::type;
+    }
+
+    /**
+     * @brief PushCapture, matches the expression and pushes the matched span onto a symbol stack
+     */
+    template< typename Stack, typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    struct PushCapture : public Pattern {
+        PushCapture( Stack& stack, const Expr& expr ) : _stack{stack}, _expr{expr} {}
+        std::optional<const char*> match( const char* src ) const override {
+            if( auto ret = _expr.match(src) ){
+                _stack.push( std::string_view( src, *ret-src ) );
+                return ret;
+            }
+            return std::nullopt;
+        }
+        detail::stack_ref<Stack> _stack;
+        const Expr               _expr;
+    };
+
+    template< typename Stack, typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    PushCapture<Stack,Expr> push_capture( Stack& stack, const Expr& expr ){
+        return PushCapture<Stack,Expr>( stack, expr );
+    }
+
+    /**
+     * @brief MatchTop, matches the text of the span on top of a symbol stack, fails if it is empty
+     */
+    template< typename Stack >
+    struct MatchTop : public Pattern {
+        MatchTop( Stack& stack ) : _stack{stack} {}
+        std::optional<const char*> match( const char* src ) const override {
+            if( !src || _stack.empty() ){
+                return std::nullopt;
+            }
+            for( char c : _stack.top() ){
+                if( *src != c ){
+                    return std::nullopt;
+                }
+                ++src;
+            }
+            return src;
+        }
+        detail::stack_ref<Stack> _stack;
+    };
+
+    template< typename Stack >
+    MatchTop<Stack> match_top( Stack& stack ){
+        return MatchTop<Stack>( stack );
+    }
+
+    /**
+     * @brief Pop, pops a symbol stack without advancing, fails if it is empty
+     */
+    template< typename Stack >
+    struct Pop : public Pattern {
+        Pop( Stack& stack ) : _stack{stack} {}
         std::optional<const char*> match( const char* src ) const override {
-            if( auto ret = _expr.match(src) ){
-                _exist_fn(src,*ret+1);
-                return ret;
+            if( _stack.pop() ){
+                return src;
             }
-            _missing_fn();
             return std::nullopt;
         }
-        const Expr        _expr;
-        RangeCallbackFn   _exist_fn;
-        MissingCallbackFn _missing_fn;
+        detail::stack_ref<Stack> _stack;
     };
 
-    template< typename Expr >
-    requires std::derived_from<Expr,Pattern>
-    RangeCallback<Expr> cb( const Expr& expr, RangeCallbackFn exist_fn, MissingCallbackFn missing_fn=defaultMissingFn ){
-        return RangeCallback( expr, exist_fn, missing_fn );
+    template< typename Stack >
+    Pop<Stack> pop( Stack& stack ){
+        return Pop<Stack>( stack );
     }
 
-    // callback that provides the matching string
-    using StringCallbackFn = std::function<void(const std::string&)>;
-
-    template< typename Expr >
+    /**
+     * @brief Rollback, an explicit choice point: restores the stack if the expression fails
+     * Alternatives and repetitions already restore it, this covers a failure that no choice point
+     * sees, e.g. that of a whole match.
+     */
+    template< typename Stack, typename Expr >
     requires std::derived_from<Expr,Pattern>
-    struct StringCallback : public Pattern {
-        StringCallback( const Expr& expr, StringCallbackFn exist_fn, MissingCallbackFn missing_fn ) : _expr{expr}, _exist_fn{exist_fn}, _missing_fn{missing_fn} {}
+    struct Rollback : public Pattern {
+        Rollback( Stack& stack, const Expr& expr ) : _stack{stack}, _expr{expr} {}
         std::optional<const char*> match( const char* src ) const override {
-            if( auto ret = _expr.match(src) ){
-                std::string tmp;
-                std::copy( src, *ret, std::back_inserter(tmp) );
-                _exist_fn(tmp);
-                return ret;
+            detail::ChoicePoint choice;
+            auto ret = _expr.match(src);
+            if( !ret ){
+                choice.unwind();
             }
-            _missing_fn();
-            return std::nullopt;
+            return ret;
         }
-        const Expr        _expr;
-        StringCallbackFn  _exist_fn;
-        MissingCallbackFn _missing_fn;
+        detail::stack_ref<Stack> _stack;
+        const Expr               _expr;
     };
 
-    template< typename Expr >
+    namespace detail {
+        template< typename Stack, typename Expr >
+        struct undoable< PushCapture<Stack,Expr> > : std::true_type {};
+        template< typename Stack >
+        struct undoable< Pop<Stack> > : std::true_type {};
+        template< typename Stack, typename Expr >
+        struct undoable< Rollback<Stack,Expr> > : undoable<Expr> {};
+    }
+
+    template< typename Stack, typename Expr >
     requires std::derived_from<Expr,Pattern>
-    StringCallback<Expr> cb( const Expr& expr, StringCallbackFn exist_fn, MissingCallbackFn missing_fn=defaultMissingFn ){
-        return StringCallback<Expr>( expr, exist_fn, missing_fn );
+    Rollback<Stack,Expr> rollback( Stack& stack, const Expr& expr ){
+        return Rollback<Stack,Expr>( stack, expr );
     }
 
+    /**
+     * @brief Arena, bump allocator whose blocks are kept and reused after an O(1) reset
+     * Deallocation is a no-op, everything allocated is reclaimed together by reset().
+     */
+    class Arena : public std::pmr::memory_resource {
+        public:
+        Arena( size_t block_size=4096 ) : _block_size{block_size} {}
+        Arena( const Arena& ) = delete;
+        Arena& operator=( const Arena& ) = delete;
+
+        void reset(){
+            _current = 0;
+            _offset  = 0;
+        }
+
+        // bytes held across resets
+        size_t capacity() const {
+            size_t total = 0;
+            for( const Block& b : _blocks ){
+                total += b.size;
+            }
+            return total;
+        }
+
+        private:
+        struct Block {
+            std::unique_ptr<std::byte[]> data;
+            size_t                       size;
+        };
+
+        void* do_allocate( size_t bytes, size_t alignment ) override {
+            while( true ){
+                if( _current == _blocks.size() ){
+                    const size_t size = std::max( _blocks.empty() ? _block_size : 2*_blocks.back().size, bytes+alignment );
+                    _blocks.push_back( { std::unique_ptr<std::byte[]>( new std::byte[size] ), size } );
+                }
+                Block& b = _blocks[_current];
+                const uintptr_t base  = reinterpret_cast<uintptr_t>( b.data.get() );
+                const size_t    start = ( (base+_offset+alignment-1) & ~uintptr_t(alignment-1) ) - base;
+                if( start+bytes <= b.size ){
+                    _offset = start+bytes;
+                    return b.data.get()+start;
+                }
+                ++_current;
+                _offset = 0;
+            }
+        }
+
+        void do_deallocate( void*, size_t, size_t ) override {}
+
+        bool do_is_equal( const std::pmr::memory_resource& other ) const noexcept override {
+            return this == &other;
+        }
+
+        std::vector<Block> _blocks;
+        size_t             _block_size;
+        size_t             _current = 0;
+        size_t             _offset  = 0;
+    };
+
+    /**
+     * @brief Session, per-parse scratch state that is reset in O(1) and reused between parses
+     * Grammars are built once against a session's symbol stack and memory resource (e.g. for
+     * cb(expr,resource,fn) strings); reset() then forgets the previous parse without freeing.
+     * Session::acquire() leases a session from a thread-local pool for worker threads.
+     */
+    template< size_t N=16 >
+    class Session {
+        public:
+        Session( size_t block_size=4096 ) : _arena{block_size} {}
+        Session( const Session& ) = delete;
+        Session& operator=( const Session& ) = delete;
+
+        std::pmr::memory_resource* resource(){ return &_arena; }
+        SymbolStack<N>& symbols(){ return _symbols; }
+        const Arena& arena() const { return _arena; }
+
+        // the symbol stack keeps its capacity since it does not allocate from the arena
+        void reset(){
+            _symbols.clear();
+            _arena.reset();
+        }
+
+        struct Release {
+            void operator()( Session* session ) const {
+                session->reset();
+                pool().emplace_back( session );
+            }
+        };
+        using Lease = std::unique_ptr<Session,Release>;
+
+        static Lease acquire(){
+            auto& free = pool();
+            if( free.empty() ){
+                return Lease( new Session() );
+            }
+            Session* session = free.back().release();
+            free.pop_back();
+            return Lease( session );
+        }
+
+        private:
+        static std::vector<std::unique_ptr<Session>>& pool(){
+            thread_local std::vector<std::unique_ptr<Session>> sessions;
+            return sessions;
+        }
+
+        Arena          _arena;
+        SymbolStack<N> _symbols;
+    };
+
+    template< typename Key >
+    struct UserFnRegistry;
+
+    /**
+     * @brief UserFnCall, the UserFn returned by UserFnRegistry::cb(key)
+     * cb( call ) builds a User node that also carries the registry's validator for the key.
+     */
+    template< typename Key >
+    struct UserFnCall {
+        std::optional<const char*> operator()( const char* src ) const {
+            return _registry->match( _key, src );
+        }
+        UserFn validator() const {
+            return [registry=_registry,key=_key]( const char* src ){ return registry->validate( key, src ); };
+        }
+        const UserFnRegistry<Key>* _registry;
+        Key _key;
+    };
+
+    // Bound expressions and the maps are allocated from the registry's memory resource.
+    // The UserFn wrappers only capture pointers so that they fit std::function's small
+    // buffer, std::function itself cannot be given an allocator.
+    // Next to each function the registry keeps its validator, bind() stores validator_of
+    // of the expression, and the User nodes built from cb(key) carry both.
     template< typename Key >
     struct UserFnRegistry {
-        UserFnRegistry(){}
+        UserFnRegistry( std::pmr::memory_resource* resource=std::pmr::get_default_resource() ) : _registry{resource}, _validators{resource}, _bound{resource} {}
 
         template< typename Expr >
         requires std::derived_from<Expr,Pattern>
         void bind( const Key& key, Expr& expr ){
-            set( key, std::bind(&Expr::match,expr,std::placeholders::_1) );
+            auto copy = std::allocate_shared<Expr>( std::pmr::polymorphic_allocator<Expr>( _bound.get_allocator() ), expr );
+            set( key, [ptr=copy.get()]( const char* src ){ return ptr->match(src); } );
+            _bound.push_back( std::move(copy) );
+            // expressions calling user functions without validators can be bound, not validated
+            try {
+                auto validator = validator_of( expr );
+                using Validator = decltype(validator);
+                auto vcopy = std::allocate_shared<Validator>( std::pmr::polymorphic_allocator<Validator>( _bound.get_allocator() ), std::move(validator) );
+                _validators[key] = [ptr=vcopy.get()]( const char* src ){ return ptr->match(src); };
+                _bound.push_back( std::move(vcopy) );
+            } catch( const std::runtime_error& ){
+            }
         }
 
-        UserFn cb( const Key& key ) const {
-            return std::bind(&UserFnRegistry<Key>::match,this,key,std::placeholders::_1);
+        UserFnCall<Key> cb( const Key& key ) const {
+            return UserFnCall<Key>{ this, key };
         }
 
         std::optional<const char*> match( const Key& key, const char* src ) const {
             return get(key)(src);
         }
 
-        void set( const Key& key, UserFn fn ){
+        std::optional<const char*> validate( const Key& key, const char* src ) const {
+            if( auto it = _validators.find(key) ; it != _validators.end() ){
+                return it->second(src);
+            }
+            throw std::runtime_error("Error: UserFn has no validator.");
+        }
+
+        void set( const Key& key, UserFn fn, UserFn validator={} ){
             if( _registry.find(key) != _registry.end() ){
                 throw std::runtime_error("Error: tried to add duplicate UserFn for key.");
             }
             _registry[key] = fn;
+            if( validator ){
+                _validators[key] = validator;
+            }
         }
 
-        UserFn get( const Key& key ) const {
+        const UserFn& get( const Key& key ) const {
             if( auto it = _registry.find(key) ; it != _registry.end() ){
                 return it->second;
             }
             throw std::runtime_error("Error: UserFn not registered.");
-            return {};
         }
 
-        std::map<Key,UserFn> _registry;
+        std::pmr::map<Key,UserFn> _registry;
+        std::pmr::map<Key,UserFn> _validators;
+        std::pmr::vector<std::shared_ptr<const void>> _bound;
     };
+
+    template< typename Key >
+    User cb( const UserFnCall<Key>& call ){
+        return User( call, call.validator() );
+    }
     
     // Overloaded pattern building operators
     template< typename Expr >
@@ -461,6 +2844,421 @@ namespace peglex {
         return And<Left,Str>(L,Str(R));
     }
 
+    // typed primitive nodes, validate and decode common record fields in a single
+    // non-virtual pass and hand the decoded value to an optional callback
+
+    namespace detail {
+        inline bool is_digit( char c ){
+            return c >= '0' && c <= '9';
+        }
+
+        inline int hex_value( char c ){
+            if( c >= '0' && c <= '9' ) return c-'0';
+            if( c >= 'a' && c <= 'f' ) return c-'a'+10;
+            if( c >= 'A' && c <= 'F' ) return c-'A'+10;
+            return -1;
+        }
+
+        // parses exactly two decimal digits
+        inline bool digits2( const char* src, int& out ){
+            if( !is_digit(src[0]) || !is_digit(src[1]) ){
+                return false;
+            }
+            out = (src[0]-'0')*10 + (src[1]-'0');
+            return true;
+        }
+
+        // days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant's days_from_civil)
+        inline int64_t days_from_civil( int64_t y, int m, int d ){
+            y -= m <= 2;
+            const int64_t era = (y >= 0 ? y : y-399) / 400;
+            const int64_t yoe = y - era*400;
+            const int64_t doy = (153*(m > 2 ? m-3 : m+9) + 2)/5 + d-1;
+            const int64_t doe = yoe*365 + yoe/4 - yoe/100 + doy;
+            return era*146097 + doe - 719468;
+        }
+
+        inline int days_in_month( int y, int m ){
+            static constexpr int days[] = {31,28,31,30,31,30,31,31,30,31,30,31};
+            const bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+            return m == 2 && leap ? 29 : days[m-1];
+        }
+    }
+
+    using TimestampCallbackFn = std::function<void(int64_t)>;
+
+    /**
+     * @brief Timestamp, matches an RFC 3339 date-time and decodes it to nanoseconds since the UTC epoch
+     * Fractions beyond nanoseconds are truncated, years outside 1678-2261 (the int64_t range) fail.
+     */
+    struct Timestamp : public Pattern {
+        Timestamp( TimestampCallbackFn fn={} ) : _fn{fn} {}
+        std::optional<const char*> match( const char* src ) const override {
+            int64_t nanos;
+            if( const char* ret = src ? decode( src, nanos ) : nullptr ){
+                if( _fn ){
+                    _fn( nanos );
+                }
+                return ret;
+            }
+            return std::nullopt;
+        }
+
+        // full-date ( 'T' / 't' / ' ' ) partial-time [ '.' 1*DIGIT ] ( 'Z' / 'z' / ( '+' / '-' ) HH ':' MM )
+        static const char* decode( const char* src, int64_t& nanos ){
+            int c, yy, mon, day, hour, min, sec;
+            if( !detail::digits2( src, c ) || !detail::digits2( src+2, yy ) || src[4] != '-' ||
+                !detail::digits2( src+5, mon ) || src[7] != '-' || !detail::digits2( src+8, day ) ||
+                (src[10] != 'T' && src[10] != 't' && src[10] != ' ') ||
+                !detail::digits2( src+11, hour ) || src[13] != ':' || !detail::digits2( src+14, min ) || src[16] != ':' ||
+                !detail::digits2( src+17, sec ) ){
+                return nullptr;
+            }
+            const int year = c*100 + yy;
+            if( year < 1678 || year > 2261 || mon < 1 || mon > 12 || day < 1 || day > detail::days_in_month( year, mon ) ||
+                hour > 23 || min > 59 || sec > 60 ){
+                return nullptr;
+            }
+            src += 19;
+
+            int64_t frac = 0;
+            if( *src == '.' ){
+                ++src;
+                if( !detail::is_digit(*src) ){
+                    return nullptr;
+                }
+                int64_t scale = 100000000;
+                for( ; detail::is_digit(*src); ++src ){
+                    frac += (*src-'0')*scale;
+                    scale /= 10;
+                }
+            }
+
+            int offset = 0;
+            if( *src == 'Z' || *src == 'z' ){
+                ++src;
+            } else if( *src == '+' || *src == '-' ){
+                int oh, om;
+                if( !detail::digits2( src+1, oh ) || src[3] != ':' || !detail::digits2( src+4, om ) || oh > 23 || om > 59 ){
+                    return nullptr;
+                }
+                offset = (*src == '-' ? -1 : 1) * (oh*3600 + om*60);
+                src += 6;
+            } else {
+                return nullptr;
+            }
+
+            // a leap second is folded into the first second of the next minute
+            const int64_t seconds = detail::days_from_civil( year, mon, day )*86400 + hour*3600 + min*60 + sec - offset;
+            nanos = seconds*1000000000 + frac;
+            return src;
+        }
+
+        TimestampCallbackFn _fn;
+    };
+    inline Timestamp timestamp( TimestampCallbackFn fn={} ){ return Timestamp(fn); }
+
+    using IPv4CallbackFn = std::function<void(uint32_t)>;
+
+    /**
+     * @brief IPv4, matches a dotted-quad address without leading zeros, decoded in host byte order
+     */
+    struct IPv4 : public Pattern {
+        IPv4( IPv4CallbackFn fn={} ) : _fn{fn} {}
+        std::optional<const char*> match( const char* src ) const override {
+            uint32_t addr;
+            if( const char* ret = src ? decode( src, addr ) : nullptr ){
+                if( _fn ){
+                    _fn( addr );
+                }
+                return ret;
+            }
+            return std::nullopt;
+        }
+
+        static const char* decode( const char* src, uint32_t& addr ){
+            addr = 0;
+            for( int i=0; i<4; ++i ){
+                if( i > 0 && *src++ != '.' ){
+                    return nullptr;
+                }
+                if( !detail::is_digit(*src) ){
+                    return nullptr;
+                }
+                unsigned octet = *src++ - '0';
+                if( octet != 0 ){
+                    for( int j=0; j<2 && detail::is_digit(*src); ++j ){
+                        octet = octet*10 + (*src++ - '0');
+                    }
+                }
+                if( octet > 255 || detail::is_digit(*src) ){
+                    return nullptr;
+                }
+                addr = (addr << 8) | octet;
+            }
+            return src;
+        }
+
+        IPv4CallbackFn _fn;
+    };
+    inline IPv4 ipv4( IPv4CallbackFn fn={} ){ return IPv4(fn); }
+
+    using IPv6CallbackFn = std::function<void(const std::array<uint8_t,16>&)>;
+
+    /**
+     * @brief IPv6, matches an RFC 4291 text address, including '::' elision and an embedded IPv4 tail
+     * Decodes to 16 bytes in network byte order.
+     */
+    struct IPv6 : public Pattern {
+        IPv6( IPv6CallbackFn fn={} ) : _fn{fn} {}
+        std::optional<const char*> match( const char* src ) const override {
+            std::array<uint8_t,16> addr;
+            if( const char* ret = src ? decode( src, addr ) : nullptr ){
+                if( _fn ){
+                    _fn( addr );
+                }
+                return ret;
+            }
+            return std::nullopt;
+        }
+
+        static const char* decode( const char* src, std::array<uint8_t,16>& addr ){
+            uint16_t groups[8];
+            int n = 0, elide = -1;
+            if( src[0] == ':' ){
+                if( src[1] != ':' ){
+                    return nullptr;
+                }
+                elide = 0;
+                src += 2;
+            }
+            while( n < 8 ){
+                uint32_t v4;
+                if( const char* end = n <= 6 ? IPv4::decode( src, v4 ) : nullptr ){
+                    groups[n++] = uint16_t(v4 >> 16);
+                    groups[n++] = uint16_t(v4);
+                    src = end;
+                    break;
+                }
+                int digits = 0;
+                unsigned group = 0;
+                for( int h; digits < 4 && (h = detail::hex_value(src[digits])) >= 0; ++digits ){
+                    group = group*16 + h;
+                }
+                if( digits == 0 ){
+                    // only a trailing '::' may be followed by something other than a group
+                    if( elide == n ){
+                        break;
+                    }
+                    return nullptr;
+                }
+                groups[n++] = uint16_t(group);
+                src += digits;
+                if( src[0] == ':' && src[1] == ':' ){
+                    if( elide >= 0 ){
+                        return nullptr;
+                    }
+                    elide = n;
+                    src += 2;
+                } else if( n < 8 && src[0] == ':' && detail::hex_value(src[1]) >= 0 ){
+                    ++src;
+                } else {
+                    break;
+                }
+            }
+            if( elide < 0 ? n != 8 : n > 7 ){
+                return nullptr;
+            }
+
+            const int tail = elide < 0 ? 0 : n-elide;
+            addr.fill(0);
+            for( int i=0; i<n; ++i ){
+                const int slot = (elide >= 0 && i >= elide) ? 8-tail+(i-elide) : i;
+                addr[2*slot]   = uint8_t(groups[i] >> 8);
+                addr[2*slot+1] = uint8_t(groups[i]);
+            }
+            return src;
+        }
+
+        IPv6CallbackFn _fn;
+    };
+    inline IPv6 ipv6( IPv6CallbackFn fn={} ){ return IPv6(fn); }
+
+    using UuidCallbackFn = std::function<void(const std::array<uint8_t,16>&)>;
+
+    /**
+     * @brief Uuid, matches the 8-4-4-4-12 hex form of an RFC 4122 UUID and decodes its 16 bytes
+     */
+    struct Uuid : public Pattern {
+        Uuid( UuidCallbackFn fn={} ) : _fn{fn} {}
+        std::optional<const char*> match( const char* src ) const override {
+            std::array<uint8_t,16> bytes;
+            if( const char* ret = src ? decode( src, bytes ) : nullptr ){
+                if( _fn ){
+                    _fn( bytes );
+                }
+                return ret;
+            }
+            return std::nullopt;
+        }
+
+        static const char* decode( const char* src, std::array<uint8_t,16>& bytes ){
+            for( int i=0; i<16; ++i ){
+                if( i == 4 || i == 6 || i == 8 || i == 10 ){
+                    if( *src++ != '-' ){
+                        return nullptr;
+                    }
+                }
+                const int hi = detail::hex_value(src[0]);
+                const int lo = hi < 0 ? -1 : detail::hex_value(src[1]);
+                if( lo < 0 ){
+                    return nullptr;
+                }
+                bytes[i] = uint8_t(hi*16 + lo);
+                src += 2;
+            }
+            return src;
+        }
+
+        UuidCallbackFn _fn;
+    };
+    inline Uuid uuid( UuidCallbackFn fn={} ){ return Uuid(fn); }
+
+    // validator projection, strips the actions from a grammar while keeping the language it
+    // matches so that the result can run speculatively, concurrently or as a pre-filter
+
+    /**
+     * @brief Converts, matches the expression if the matched text converts to T, discarding the value
+     * Stands in for Field and Column nodes, whose conversions can reject input.
+     */
+    template< typename T, typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    struct Converts : public Pattern {
+        Converts( const Expr& expr ) : _expr{expr} {}
+        std::optional<const char*> match( const char* src ) const override {
+            if( auto ret = _expr.match(src) ){
+                T value{};
+                if( from_text( src, *ret, value ) ){
+                    return ret;
+                }
+            }
+            return std::nullopt;
+        }
+        const Expr _expr;
+    };
+
+    // wraps a stripped expression in Converts unless every text converts to T
+    template< typename T, typename Expr >
+    auto converting( const Expr& expr ){
+        if constexpr( std::is_same_v<T,std::string_view> || std::is_same_v<T,std::string> ){
+            return expr;
+        } else {
+            return Converts<T,Expr>( expr );
+        }
+    }
+
+    // nodes without actions are kept as they are. User nodes switch to their validator and throw
+    // if they have none, since their functions are opaque. Symbol-stack nodes are rebuilt over
+    // ThreadStack handles, so validators never touch the caller's stacks nor share them across threads.
+    template< typename Expr >
+    requires std::derived_from<Expr,Pattern>
+    Expr validator_of( const Expr& expr ){ return expr; }
+
+    template< typename Expr >
+    auto validator_of( const Check<Expr>& e ){ return check( validator_of(e._expr) ); }
+
+    template< typename Expr >
+    auto validator_of( const Not<Expr>& e ){ return !validator_of(e._expr); }
+
+    template< typename Expr >
+    auto validator_of( const ZeroPlus<Expr>& e ){ return star( validator_of(e._expr) ); }
+
+    template< typename Expr >
+    auto validator_of( const Until<Expr>& e ){ return until( validator_of(e._expr) ); }
+
+    template< typename Left, typename Right >
+    auto validator_of( const Or<Left,Right>& e ){ return validator_of(e._left) | validator_of(e._right); }
+
+    template< typename Left, typename Right >
+    auto validator_of( const And<Left,Right>& e ){ return validator_of(e._left) & validator_of(e._right); }
+
+    template< typename Expr >
+    auto validator_of( const ExistCallback<Expr>& e ){ return validator_of(e._expr); }
+
+    template< typename Expr >
+    auto validator_of( const RangeCallback<Expr>& e ){ return validator_of(e._expr); }
+
+    template< typename Expr, typename String >
+    auto validator_of( const StringCallback<Expr,String>& e ){ return validator_of(e._expr); }
+
+    template< typename Batch, typename Expr >
+    auto validator_of( const Row<Batch,Expr>& e ){ return validator_of(e._expr); }
+
+    template< size_t N, typename Batch, typename Expr >
+    auto validator_of( const Column<N,Batch,Expr>& e ){
+        using T = typename std::remove_cvref_t<decltype(e._batch.template column<N>())>::value_type;
+        return converting<T>( validator_of(e._expr) );
+    }
+
+    template< auto Member, typename Expr >
+    auto validator_of( const Field<Member,Expr>& e ){
+        using T = typename member_pointer_traits<decltype(Member)>::value_type;
+        return converting<T>( validator_of(e._expr) );
+    }
+
+    template< typename T, typename Expr >
+    auto validator_of( const Converts<T,Expr>& e ){
+        return converting<T>( validator_of(e._expr) );
+    }
+
+    inline User validator_of( const User& e ){
+        if( !e._validator ){
+            throw std::runtime_error("Error: user function has no validator.");
+        }
+        return User( e._validator, e._validator );
+    }
+
+    inline AnyRule validator_of( const AnyRule& e ){ return e.validator(); }
+
+    namespace detail {
+        template< typename Stack >
+        ThreadStack<Stack> thread_stack( const Stack& stack ){ return ThreadStack<Stack>( stack ); }
+        template< typename Stack >
+        ThreadStack<Stack> thread_stack( const ThreadStack<Stack>& stack ){ return stack; }
+    }
+
+    template< typename Stack, typename Expr >
+    auto validator_of( const PushCapture<Stack,Expr>& e ){
+        auto stack = detail::thread_stack( e._stack );
+        return push_capture( stack, validator_of(e._expr) );
+    }
+
+    template< typename Stack >
+    auto validator_of( const MatchTop<Stack>& e ){
+        auto stack = detail::thread_stack( e._stack );
+        return match_top( stack );
+    }
+
+    template< typename Stack >
+    auto validator_of( const Pop<Stack>& e ){
+        auto stack = detail::thread_stack( e._stack );
+        return pop( stack );
+    }
+
+    template< typename Stack, typename Expr >
+    auto validator_of( const Rollback<Stack,Expr>& e ){
+        auto stack = detail::thread_stack( e._stack );
+        return rollback( stack, validator_of(e._expr) );
+    }
+
+    inline Timestamp validator_of( const Timestamp& ){ return Timestamp(); }
+    inline IPv4      validator_of( const IPv4& ){ return IPv4(); }
+    inline IPv6      validator_of( const IPv6& ){ return IPv6(); }
+    inline Uuid      validator_of( const Uuid& ){ return Uuid(); }
+
+    template< typename Expr >
+    using validator_t = decltype( validator_of( std::declval<const Expr&>() ) );
+
     // convenience definitions
     inline Char  eof(){ return Char('\0'); }
     inline Char  space(){ return Char(' '); }
@@ -478,4 +3276,33 @@ namespace peglex {
     inline auto  pm(){ return Char('+') | Char('-'); }
     inline auto  integer(){ return maybe(pm()) & digits(); }
     inline auto  real(){ return maybe(pm()) & digits() & Char('.') & maybe(digits()) & maybe( (Char('e')|Char('E')) & maybe(pm()) & digits() ); }
+
+    // With PEGLEX_PRECOMPILED defined (e.g. by linking the peglex_precompiled target) the node
+    // types behind the convenience definitions are instantiated once in that library rather
+    // than in every translation unit. src/precompiled.cpp defines PEGLEX_PRECOMPILED_DEFINE
+    // to turn these declarations into the definitions.
+#ifdef PEGLEX_PRECOMPILED
+#ifdef PEGLEX_PRECOMPILED_DEFINE
+#define PEGLEX_EXTERN_TEMPLATE template
+#else
+#define PEGLEX_EXTERN_TEMPLATE extern template
+#endif
+    PEGLEX_EXTERN_TEMPLATE struct Or<Char,Char>;
+    PEGLEX_EXTERN_TEMPLATE struct Or<Or<Char,Char>,Char>;
+    PEGLEX_EXTERN_TEMPLATE struct Or<Or<Or<Char,Char>,Char>,Char>;
+    PEGLEX_EXTERN_TEMPLATE struct Or<Range,Range>;
+    PEGLEX_EXTERN_TEMPLATE struct Or<Or<Range,Range>,Range>;
+    PEGLEX_EXTERN_TEMPLATE struct ZeroPlus<Range>;
+    PEGLEX_EXTERN_TEMPLATE struct And<Range,ZeroPlus<Range>>;
+    PEGLEX_EXTERN_TEMPLATE struct Or<Or<Char,Char>,Eps>;
+    PEGLEX_EXTERN_TEMPLATE struct Or<And<Range,ZeroPlus<Range>>,Eps>;
+    PEGLEX_EXTERN_TEMPLATE struct And<Or<Or<Char,Char>,Eps>,And<Range,ZeroPlus<Range>>>;
+    PEGLEX_EXTERN_TEMPLATE struct And<And<Or<Or<Char,Char>,Eps>,And<Range,ZeroPlus<Range>>>,Char>;
+    PEGLEX_EXTERN_TEMPLATE struct And<And<And<Or<Or<Char,Char>,Eps>,And<Range,ZeroPlus<Range>>>,Char>,Or<And<Range,ZeroPlus<Range>>,Eps>>;
+    PEGLEX_EXTERN_TEMPLATE struct And<Or<Char,Char>,Or<Or<Char,Char>,Eps>>;
+    PEGLEX_EXTERN_TEMPLATE struct And<And<Or<Char,Char>,Or<Or<Char,Char>,Eps>>,And<Range,ZeroPlus<Range>>>;
+    PEGLEX_EXTERN_TEMPLATE struct Or<And<And<Or<Char,Char>,Or<Or<Char,Char>,Eps>>,And<Range,ZeroPlus<Range>>>,Eps>;
+    PEGLEX_EXTERN_TEMPLATE struct And<And<And<And<Or<Or<Char,Char>,Eps>,And<Range,ZeroPlus<Range>>>,Char>,Or<And<Range,ZeroPlus<Range>>,Eps>>,Or<And<And<Or<Char,Char>,Or<Or<Char,Char>,Eps>>,And<Range,ZeroPlus<Range>>>,Eps>>;
+#undef PEGLEX_EXTERN_TEMPLATE
+#endif
 };
\ No newline at end of file
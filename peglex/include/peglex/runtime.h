@@ -0,0 +1,1343 @@
+// (c) James Gregson 2024, MIT license
+#pragma once
+
+#include <peglex/peglex.h>
+
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if __has_include(<dlfcn.h>) && __has_include(<spawn.h>)
+#include <cerrno>
+#include <dlfcn.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#define PEGLEX_HAS_DLOPEN 1
+extern char** environ;
+#endif
+
+extern "C" {
+    /**
+     * @brief C ABI of compiled grammar plugins, one entry point per rule
+     * end may be null for NUL terminated input, ctx is passed through untouched.
+     * Entry points return one past the match or null on failure.
+     */
+    typedef const char* (*peglex_match_fn)( const char* begin, const char* end, void* ctx );
+
+    // source holds the grammar text the plugin was generated from
+    struct peglex_plugin {
+        uint32_t               abi;
+        uint32_t               num_rules;
+        uint64_t               key;
+        const peglex_match_fn* rules;
+        const char* const*     names;
+        const char*            source;
+        uint64_t               source_size;
+    };
+}
+
+// symbol of the peglex_plugin descriptor exported by each plugin, renamed when its layout changes
+#define PEGLEX_PLUGIN_SYMBOL "peglex_plugin_v2"
+
+namespace peglex::runtime {
+
+    // bumped whenever the image layout or the compiler output changes, part of every cache key
+    inline constexpr uint32_t format_version = 1;
+
+    enum class Op : uint8_t { Eps, Set, Span, Lit, Seq, Choice, Star, Plus, Maybe, Not, Check, Ref };
+
+    /**
+     * @brief Node of a compiled grammar, operands are table indices so that images are relocatable
+     * Set matches one byte of set a, Span at least b bytes of set a. Lit compares the b bytes at
+     * offset a of the byte table. Seq and Choice have b children starting at a in the child table,
+     * Ref calls rule a and the remaining ops apply to the single child node a.
+     */
+    struct Node {
+        Op       op;
+        uint32_t a = 0;
+        uint32_t b = 0;
+    };
+
+    struct RuleEntry {
+        uint32_t node;
+        uint32_t name;       // offset of the name in the byte table
+        uint32_t name_size;
+    };
+
+    // 256-bit byte set, never contains the terminator
+    using CharSet = std::array<uint64_t,4>;
+
+    inline bool contains( const CharSet& set, char c ){
+        const unsigned char u = static_cast<unsigned char>(c);
+        return (set[u >> 6] >> (u & 63)) & 1;
+    }
+
+    inline void insert( CharSet& set, unsigned char c ){
+        set[c >> 6] |= uint64_t(1) << (c & 63);
+    }
+
+    // FNV-1a of the source, seeded with the image format so that format changes miss the cache
+    inline uint64_t key_of( std::string_view source ){
+        uint64_t h = 0xcbf29ce484222325ull ^ format_version;
+        for( char c : source ){
+            h = (h ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+        }
+        return h;
+    }
+
+    namespace detail {
+        inline constexpr char magic[8] = { 'p','e','g','l','e','x','g','\0' };
+
+        // image layout: Header, sets, nodes, children, rules, bytes, source; offsets are from the image start
+        struct Header {
+            char     magic[8];
+            uint32_t format;
+            uint32_t image_size;
+            uint64_t key;
+            uint32_t num_sets, num_nodes, num_children, num_rules, bytes_size, source_size;
+            uint32_t sets, nodes, children, rules, bytes, source;
+        };
+
+        /**
+         * @brief Program, a validated image and views of its tables, evaluated by a recursive interpreter
+         */
+        struct Program {
+            Program( PaddedBuffer image ) : image{std::move(image)} {
+                const char* base = this->image.data();
+                const size_t size = this->image.size();
+                auto table = [&]( uint32_t offset, uint32_t count, size_t elem, size_t align ){
+                    if( offset % align || offset > size || count > (size-offset)/elem ){
+                        throw std::runtime_error("Error: malformed grammar image.");
+                    }
+                    return base+offset;
+                };
+                if( size < sizeof(Header) ){
+                    throw std::runtime_error("Error: malformed grammar image.");
+                }
+                header = reinterpret_cast<const Header*>( base );
+                if( std::memcmp( header->magic, magic, sizeof(magic) ) != 0 || header->format != format_version || header->image_size != size ){
+                    throw std::runtime_error("Error: malformed grammar image.");
+                }
+                sets     = reinterpret_cast<const CharSet*>( table( header->sets, header->num_sets, sizeof(CharSet), alignof(CharSet) ) );
+                nodes    = reinterpret_cast<const Node*>( table( header->nodes, header->num_nodes, sizeof(Node), alignof(Node) ) );
+                children = reinterpret_cast<const uint32_t*>( table( header->children, header->num_children, sizeof(uint32_t), alignof(uint32_t) ) );
+                rules    = reinterpret_cast<const RuleEntry*>( table( header->rules, header->num_rules, sizeof(RuleEntry), alignof(RuleEntry) ) );
+                bytes    = table( header->bytes, header->bytes_size, 1, 1 );
+                source   = table( header->source, header->source_size, 1, 1 );
+                validate();
+            }
+
+            // operands are checked once here so that eval() needs no bounds checks, children must
+            // precede their parent as emitted so that nodes cannot form cycles
+            void validate() const {
+                const Header& h = *header;
+                bool ok = h.num_rules > 0;
+                for( uint32_t i=0; ok && i<h.num_nodes; ++i ){
+                    const Node& n = nodes[i];
+                    switch( n.op ){
+                        case Op::Eps:    break;
+                        case Op::Set:
+                        case Op::Span:   ok = n.a < h.num_sets; break;
+                        case Op::Lit:    ok = n.a <= h.bytes_size && n.b <= h.bytes_size-n.a && !std::memchr( bytes+n.a, 0, n.b ); break;
+                        case Op::Seq:
+                        case Op::Choice:
+                            ok = n.a <= h.num_children && n.b <= h.num_children-n.a;
+                            for( uint32_t c=0; ok && c<n.b; ++c ){
+                                ok = children[n.a+c] < i;
+                            }
+                            break;
+                        case Op::Star:
+                        case Op::Plus:
+                        case Op::Maybe:
+                        case Op::Not:
+                        case Op::Check:  ok = n.a < i; break;
+                        case Op::Ref:    ok = n.a < h.num_rules; break;
+                        default:         ok = false;
+                    }
+                }
+                for( uint32_t i=0; ok && i<h.num_rules; ++i ){
+                    ok = rules[i].node < h.num_nodes && rules[i].name <= h.bytes_size && rules[i].name_size <= h.bytes_size-rules[i].name;
+                }
+                for( uint32_t i=0; ok && i<h.num_sets; ++i ){
+                    ok = !contains( sets[i], '\0' );
+                }
+                if( !ok ){
+                    throw std::runtime_error("Error: malformed grammar image.");
+                }
+            }
+
+            // returns the advanced pointer or nullptr on failure
+            const char* eval( uint32_t n, const char* p ) const {
+                return eval( n, p, [this]( uint32_t rule, const char* q ){ return eval( rules[rule].node, q ); } );
+            }
+
+            // as eval(n,p), with rule references dispatched through call(rule,p)
+            template< typename Call >
+            const char* eval( uint32_t n, const char* p, const Call& call ) const {
+                const Node& node = nodes[n];
+                switch( node.op ){
+                    case Op::Eps:
+                        return p;
+                    case Op::Set:
+                        return contains( sets[node.a], *p ) ? p+1 : nullptr;
+                    case Op::Span: {
+                        const char* start = p;
+                        while( contains( sets[node.a], *p ) ){
+                            ++p;
+                        }
+                        return size_t(p-start) >= node.b ? p : nullptr;
+                    }
+                    case Op::Lit:
+                        for( uint32_t i=0; i<node.b; ++i ){
+                            if( p[i] != bytes[node.a+i] ){
+                                return nullptr;
+                            }
+                        }
+                        return p+node.b;
+                    case Op::Seq:
+                        for( uint32_t i=0; p && i<node.b; ++i ){
+                            p = eval( children[node.a+i], p, call );
+                        }
+                        return p;
+                    case Op::Choice:
+                        for( uint32_t i=0; i<node.b; ++i ){
+                            if( const char* r = eval( children[node.a+i], p, call ) ){
+                                return r;
+                            }
+                        }
+                        return nullptr;
+                    case Op::Plus:
+                        if( !(p = eval( node.a, p, call )) ){
+                            return nullptr;
+                        }
+                        [[fallthrough]];
+                    case Op::Star:
+                        while( const char* r = eval( node.a, p, call ) ){
+                            if( r == p ){
+                                break;
+                            }
+                            p = r;
+                        }
+                        return p;
+                    case Op::Maybe: {
+                        const char* r = eval( node.a, p, call );
+                        return r ? r : p;
+                    }
+                    case Op::Not:
+                        return eval( node.a, p, call ) ? nullptr : p;
+                    case Op::Check:
+                        return eval( node.a, p, call ) ? p : nullptr;
+                    case Op::Ref:
+                        return call( node.a, p );
+                }
+                return nullptr;
+            }
+
+            PaddedBuffer     image;
+            const Header*    header;
+            const CharSet*   sets;
+            const Node*      nodes;
+            const uint32_t*  children;
+            const RuleEntry* rules;
+            const char*      bytes;
+            const char*      source;
+        };
+
+        // parse tree of grammar text before folding and flattening
+        struct Ast {
+            Op               op = Op::Eps;
+            CharSet          set{};
+            std::string      text{};  // literal bytes, or the rule name of a Ref
+            uint32_t         min = 0;
+            std::vector<Ast> kids{};
+        };
+
+        /**
+         * @brief GrammarParser, recursive descent over PEG text
+         *   grammar <- (name '<-' expr)+      expr   <- seq ('/' seq)*
+         *   seq     <- prefix*                prefix <- ('&' / '!')? suffix
+         *   suffix  <- primary ('*' / '+' / '?')*
+         *   primary <- name / '(' expr ')' / 'lit' / "lit" / [class] / '.'
+         * Comments run from '#' to the end of the line, the first rule is the start rule.
+         */
+        class GrammarParser {
+            public:
+            GrammarParser( std::string_view source ) : _src{source.data()}, _end{source.data()+source.size()} {}
+
+            std::vector<std::pair<std::string,Ast>> parse(){
+                std::vector<std::pair<std::string,Ast>> rules;
+                spacing();
+                while( _src < _end ){
+                    std::string name = identifier();
+                    if( name.empty() ){
+                        fail( "expected rule name" );
+                    }
+                    for( auto& rule : rules ){
+                        if( rule.first == name ){
+                            fail( "duplicate rule '"+name+"'" );
+                        }
+                    }
+                    spacing();
+                    if( !accept( "<-" ) ){
+                        fail( "expected '<-'" );
+                    }
+                    rules.emplace_back( std::move(name), expr() );
+                }
+                if( rules.empty() ){
+                    fail( "empty grammar" );
+                }
+                return rules;
+            }
+
+            private:
+            Ast expr(){
+                Ast choice{ Op::Choice };
+                choice.kids.push_back( seq() );
+                while( accept( "/" ) ){
+                    choice.kids.push_back( seq() );
+                }
+                return choice;
+            }
+
+            Ast seq(){
+                Ast seq{ Op::Seq };
+                while( _src < _end && *_src != '/' && *_src != ')' && !at_definition() ){
+                    seq.kids.push_back( prefix() );
+                }
+                return seq;
+            }
+
+            Ast prefix(){
+                for( Op op : { Op::Check, Op::Not } ){
+                    if( accept( op == Op::Check ? "&" : "!" ) ){
+                        Ast e{ op };
+                        e.kids.push_back( suffix() );
+                        return e;
+                    }
+                }
+                return suffix();
+            }
+
+            Ast suffix(){
+                Ast e = primary();
+                while( _src < _end && (*_src == '*' || *_src == '+' || *_src == '?') ){
+                    Ast outer{ *_src == '*' ? Op::Star : *_src == '+' ? Op::Plus : Op::Maybe };
+                    outer.kids.push_back( std::move(e) );
+                    e = std::move(outer);
+                    ++_src;
+                    spacing();
+                }
+                return e;
+            }
+
+            Ast primary(){
+                if( _src >= _end ){
+                    fail( "unexpected end of grammar" );
+                }
+                Ast e;
+                const char c = *_src;
+                if( c == '(' ){
+                    ++_src;
+                    spacing();
+                    e = expr();
+                    if( !accept( ")" ) ){
+                        fail( "expected ')'" );
+                    }
+                    return e;
+                }
+                if( c == '\'' || c == '"' ){
+                    ++_src;
+                    e.op = Op::Lit;
+                    while( _src < _end && *_src != c ){
+                        e.text += escaped();
+                    }
+                    close( c );
+                } else if( c == '[' ){
+                    ++_src;
+                    e.op = Op::Set;
+                    const bool negate = _src < _end && *_src == '^';
+                    if( negate ){
+                        ++_src;
+                    }
+                    while( _src < _end && *_src != ']' ){
+                        const unsigned char lo = escaped();
+                        unsigned char hi = lo;
+                        if( _src+1 < _end && *_src == '-' && _src[1] != ']' ){
+                            ++_src;
+                            hi = escaped();
+                        }
+                        for( unsigned b=lo; b<=hi; ++b ){
+                            insert( e.set, b );
+                        }
+                    }
+                    close( ']' );
+                    if( negate ){
+                        for( uint64_t& w : e.set ){
+                            w = ~w;
+                        }
+                        e.set[0] &= ~uint64_t(1);
+                    }
+                } else if( c == '.' ){
+                    ++_src;
+                    e.op = Op::Set;
+                    e.set = { ~uint64_t(1), ~uint64_t(0), ~uint64_t(0), ~uint64_t(0) };
+                    spacing();
+                } else {
+                    e.op = Op::Ref;
+                    e.text = identifier();
+                    if( e.text.empty() ){
+                        fail( "unexpected character" );
+                    }
+                    spacing();
+                }
+                return e;
+            }
+
+            // one possibly escaped byte of a literal or class, the terminator is rejected
+            char escaped(){
+                char c = *_src++;
+                if( c == '\\' ){
+                    if( _src >= _end ){
+                        fail( "unterminated escape" );
+                    }
+                    switch( c = *_src++ ){
+                        case 'n': c = '\n'; break;
+                        case 'r': c = '\r'; break;
+                        case 't': c = '\t'; break;
+                        case 'x': {
+                            int v = 0;
+                            for( int i=0; i<2; ++i ){
+                                const int d = _src < _end ? hex_value( *_src++ ) : -1;
+                                if( d < 0 ){
+                                    fail( "malformed \\x escape" );
+                                }
+                                v = v*16 + d;
+                            }
+                            c = char(v);
+                            break;
+                        }
+                        default: break;
+                    }
+                }
+                if( c == '\0' ){
+                    fail( "NUL is not allowed in literals or classes" );
+                }
+                return c;
+            }
+
+            static int hex_value( char c ){
+                if( c >= '0' && c <= '9' ) return c-'0';
+                if( c >= 'a' && c <= 'f' ) return c-'a'+10;
+                if( c >= 'A' && c <= 'F' ) return c-'A'+10;
+                return -1;
+            }
+
+            void close( char c ){
+                if( _src >= _end || *_src != c ){
+                    fail( "unterminated literal or class" );
+                }
+                ++_src;
+                spacing();
+            }
+
+            std::string identifier(){
+                const char* start = _src;
+                while( _src < _end && (std::isalpha( static_cast<unsigned char>(*_src) ) || *_src == '_' || (_src > start && std::isdigit( static_cast<unsigned char>(*_src) ))) ){
+                    ++_src;
+                }
+                return std::string( start, _src );
+            }
+
+            // a name followed by '<-' starts the next rule rather than continuing a sequence
+            bool at_definition(){
+                const char* save = _src;
+                const bool found = !identifier().empty() && (spacing(), accept( "<-" ));
+                _src = save;
+                return found;
+            }
+
+            bool accept( std::string_view token ){
+                if( size_t(_end-_src) >= token.size() && std::string_view( _src, token.size() ) == token ){
+                    _src += token.size();
+                    spacing();
+                    return true;
+                }
+                return false;
+            }
+
+            void spacing(){
+                while( _src < _end ){
+                    if( *_src == '#' ){
+                        while( _src < _end && *_src != '\n' ){
+                            ++_src;
+                        }
+                    } else if( std::isspace( static_cast<unsigned char>(*_src) ) ){
+                        ++_src;
+                    } else {
+                        break;
+                    }
+                }
+            }
+
+            [[noreturn]] void fail( const std::string& what ) const {
+                throw std::runtime_error( "Error: "+what+" in grammar." );
+            }
+
+            const char* _src;
+            const char* _end;
+        };
+
+        // char-set folding: single bytes become sets, adjacent set alternatives merge and repeated sets become spans
+        inline Ast fold( Ast e ){
+            std::vector<Ast> kids;
+            for( Ast& kid : e.kids ){
+                Ast folded = fold( std::move(kid) );
+                if( folded.op == e.op && (e.op == Op::Seq || e.op == Op::Choice) ){
+                    std::move( folded.kids.begin(), folded.kids.end(), std::back_inserter( kids ) );
+                } else if( e.op == Op::Seq && folded.op == Op::Eps ){
+                    continue;
+                } else if( e.op == Op::Choice && folded.op == Op::Set && !kids.empty() && kids.back().op == Op::Set ){
+                    for( int w=0; w<4; ++w ){
+                        kids.back().set[w] |= folded.set[w];
+                    }
+                } else {
+                    kids.push_back( std::move(folded) );
+                }
+            }
+            e.kids = std::move(kids);
+            switch( e.op ){
+                case Op::Lit:
+                    if( e.text.size() <= 1 ){
+                        e.op = e.text.empty() ? Op::Eps : Op::Set;
+                        if( !e.text.empty() ){
+                            insert( e.set, static_cast<unsigned char>(e.text[0]) );
+                        }
+                    }
+                    break;
+                case Op::Seq:
+                case Op::Choice:
+                    if( e.kids.empty() ){
+                        return Ast{ Op::Eps };
+                    }
+                    if( e.kids.size() == 1 ){
+                        return std::move( e.kids[0] );
+                    }
+                    break;
+                case Op::Star:
+                case Op::Plus:
+                    if( e.kids[0].op == Op::Set ){
+                        e.min = e.op == Op::Plus;
+                        e.op  = Op::Span;
+                        e.set = e.kids[0].set;
+                        e.kids.clear();
+                    }
+                    break;
+                default:
+                    break;
+            }
+            return e;
+        }
+
+        /**
+         * @brief Emitter, flattens folded rules into the tables of an image
+         */
+        struct Emitter {
+            uint32_t emit( const Ast& e ){
+                Node node{ e.op };
+                switch( e.op ){
+                    case Op::Set:
+                    case Op::Span: {
+                        auto [it,inserted] = set_index.try_emplace( e.set, uint32_t(sets.size()) );
+                        if( inserted ){
+                            sets.push_back( e.set );
+                        }
+                        node.a = it->second;
+                        node.b = e.min;
+                        break;
+                    }
+                    case Op::Lit:
+                        node.a = uint32_t(bytes.size());
+                        node.b = uint32_t(e.text.size());
+                        bytes += e.text;
+                        break;
+                    case Op::Seq:
+                    case Op::Choice: {
+                        std::vector<uint32_t> ids;
+                        for( const Ast& kid : e.kids ){
+                            ids.push_back( emit( kid ) );
+                        }
+                        node.a = uint32_t(children.size());
+                        node.b = uint32_t(ids.size());
+                        children.insert( children.end(), ids.begin(), ids.end() );
+                        break;
+                    }
+                    case Op::Ref: {
+                        auto it = rule_index.find( e.text );
+                        if( it == rule_index.end() ){
+                            throw std::runtime_error( "Error: undefined rule '"+e.text+"' in grammar." );
+                        }
+                        node.a = it->second;
+                        break;
+                    }
+                    case Op::Eps:
+                        break;
+                    default:
+                        node.a = emit( e.kids[0] );
+                }
+                nodes.push_back( node );
+                return uint32_t(nodes.size()-1);
+            }
+
+            std::map<CharSet,uint32_t>      set_index;
+            std::map<std::string,uint32_t>  rule_index;
+            std::vector<CharSet>            sets;
+            std::vector<Node>               nodes;
+            std::vector<uint32_t>           children;
+            std::string                     bytes;
+        };
+
+        template< typename T >
+        uint32_t append( std::string& image, const T* data, size_t count ){
+            image.resize( (image.size()+alignof(T)-1) / alignof(T) * alignof(T) );
+            const uint32_t offset = uint32_t(image.size());
+            image.append( reinterpret_cast<const char*>(data), count*sizeof(T) );
+            return offset;
+        }
+    }
+
+    class Grammar;
+    class TieredGrammar;
+
+    /**
+     * @brief Rule, one rule of a runtime grammar as a Pattern, keeps the grammar image alive
+     */
+    class Rule : public Pattern {
+        public:
+        std::optional<const char*> match( const char* src ) const override {
+            if( const char* ret = src ? _program->eval( _program->rules[_index].node, src ) : nullptr ){
+                return ret;
+            }
+            return std::nullopt;
+        }
+
+        uint32_t index() const { return _index; }
+
+        private:
+        friend class Grammar;
+        Rule( std::shared_ptr<const detail::Program> program, uint32_t index ) : _program{std::move(program)}, _index{index} {}
+        std::shared_ptr<const detail::Program> _program;
+        uint32_t                               _index;
+    };
+
+    /**
+     * @brief Grammar, PEG text compiled into a flat, relocatable image and matched by an interpreter
+     * The image holds no pointers, so it can be written to disk and mapped back as is (see GrammarCache).
+     * Copies share the image. Left-recursive rules are not detected and recurse without bound.
+     */
+    class Grammar {
+        public:
+        // parses, folds and flattens PEG text, throws std::runtime_error on malformed grammars
+        static Grammar compile( std::string_view source ){
+            auto rules = detail::GrammarParser( source ).parse();
+
+            detail::Emitter emitter;
+            for( uint32_t i=0; i<rules.size(); ++i ){
+                emitter.rule_index.emplace( rules[i].first, i );
+            }
+            std::vector<RuleEntry> entries;
+            for( auto& [name,body] : rules ){
+                const uint32_t node = emitter.emit( detail::fold( std::move(body) ) );
+                entries.push_back( { node, uint32_t(emitter.bytes.size()), uint32_t(name.size()) } );
+                emitter.bytes += name;
+            }
+
+            detail::Header header{};
+            std::memcpy( header.magic, detail::magic, sizeof(header.magic) );
+            header.format       = format_version;
+            header.key          = key_of( source );
+            header.num_sets     = uint32_t(emitter.sets.size());
+            header.num_nodes    = uint32_t(emitter.nodes.size());
+            header.num_children = uint32_t(emitter.children.size());
+            header.num_rules    = uint32_t(entries.size());
+            header.bytes_size   = uint32_t(emitter.bytes.size());
+            header.source_size  = uint32_t(source.size());
+
+            std::string image( sizeof(header), '\0' );
+            header.sets       = detail::append( image, emitter.sets.data(), emitter.sets.size() );
+            header.nodes      = detail::append( image, emitter.nodes.data(), emitter.nodes.size() );
+            header.children   = detail::append( image, emitter.children.data(), emitter.children.size() );
+            header.rules      = detail::append( image, entries.data(), entries.size() );
+            header.bytes      = detail::append( image, emitter.bytes.data(), emitter.bytes.size() );
+            header.source     = detail::append( image, source.data(), source.size() );
+            header.image_size = uint32_t(image.size());
+            std::memcpy( image.data(), &header, sizeof(header) );
+            return load( PaddedBuffer( image ) );
+        }
+
+        // adopts a compiled image, e.g. one mapped from disk, throws std::runtime_error if it is malformed
+        static Grammar load( PaddedBuffer image ){
+            return Grammar( std::make_shared<const detail::Program>( std::move(image) ) );
+        }
+
+        std::string_view image() const { return _program->image.view(); }
+        std::string_view source() const { return { _program->source, _program->header->source_size }; }
+        uint64_t key() const { return _program->header->key; }
+
+        std::span<const CharSet>   sets() const { return { _program->sets, _program->header->num_sets }; }
+        std::span<const Node>      nodes() const { return { _program->nodes, _program->header->num_nodes }; }
+        std::span<const uint32_t>  children() const { return { _program->children, _program->header->num_children }; }
+        std::span<const RuleEntry> rules() const { return { _program->rules, _program->header->num_rules }; }
+        std::string_view           bytes() const { return { _program->bytes, _program->header->bytes_size }; }
+
+        std::string_view name( uint32_t rule ) const {
+            const RuleEntry& e = _program->rules[rule];
+            return { _program->bytes+e.name, e.name_size };
+        }
+
+        std::optional<uint32_t> find( std::string_view name ) const {
+            for( uint32_t i=0; i<_program->header->num_rules; ++i ){
+                if( this->name(i) == name ){
+                    return i;
+                }
+            }
+            return std::nullopt;
+        }
+
+        Rule rule( uint32_t index=0 ) const {
+            if( index >= _program->header->num_rules ){
+                throw std::runtime_error("Error: rule index out of range.");
+            }
+            return Rule( _program, index );
+        }
+
+        Rule rule( std::string_view name ) const {
+            if( auto index = find( name ) ){
+                return Rule( _program, *index );
+            }
+            throw std::runtime_error("Error: no rule with that name.");
+        }
+
+        std::optional<const char*> match( const char* src, uint32_t rule=0 ) const {
+            return this->rule( rule ).match( src );
+        }
+
+        private:
+        friend class TieredGrammar;
+        Grammar( std::shared_ptr<const detail::Program> program ) : _program{std::move(program)} {}
+        std::shared_ptr<const detail::Program> _program;
+    };
+
+    /**
+     * @brief GrammarCache, compiled grammar images on disk, addressed by key_of(source)
+     * Hits map the stored image (or read it where mmap is unavailable) and skip compilation. The
+     * stored source is compared on load, so hash collisions and damaged files fall back to compiling.
+     * Images are written to a temporary file and renamed into place, so concurrent processes may share
+     * a directory.
+     */
+    class GrammarCache {
+        public:
+        GrammarCache( std::filesystem::path directory ) : _directory{std::move(directory)} {
+            std::error_code ec;
+            std::filesystem::create_directories( _directory, ec );
+        }
+
+        // the cached grammar for source, compiling and storing it on a miss, a cache that cannot
+        // be written to only costs the compile
+        Grammar get( std::string_view source ){
+            const std::filesystem::path file = path( source );
+            if( std::filesystem::exists( file ) ){
+                try {
+#ifdef PEGLEX_HAS_MMAP
+                    Grammar grammar = Grammar::load( PaddedBuffer::map_file( file.c_str() ) );
+#else
+                    Grammar grammar = Grammar::load( PaddedBuffer::from_file( file.string().c_str() ) );
+#endif
+                    if( grammar.source() == source ){
+                        ++_hits;
+                        return grammar;
+                    }
+                } catch( const std::runtime_error& ){
+                    // unreadable or stale, recompiled below
+                }
+            }
+            ++_misses;
+            Grammar grammar = Grammar::compile( source );
+            store( file, grammar.image() );
+            return grammar;
+        }
+
+        std::filesystem::path path( std::string_view source ) const {
+            char name[32];
+            std::snprintf( name, sizeof(name), "%016llx.peglex", static_cast<unsigned long long>(key_of( source )) );
+            return _directory / name;
+        }
+
+        size_t hits() const { return _hits; }
+        size_t misses() const { return _misses; }
+
+        private:
+        static bool store( const std::filesystem::path& file, std::string_view image ){
+            std::filesystem::path tmp = file;
+            tmp += ".tmp" + std::to_string( std::random_device{}() );
+            std::FILE* fp = std::fopen( tmp.string().c_str(), "wb" );
+            bool ok = fp && std::fwrite( image.data(), 1, image.size(), fp ) == image.size();
+            if( fp ){
+                ok = std::fclose( fp ) == 0 && ok;
+            }
+            std::error_code ec;
+            if( ok ){
+                std::filesystem::rename( tmp, file, ec );
+            }
+            if( !ok || ec ){
+                std::filesystem::remove( tmp, ec );
+                return false;
+            }
+            return true;
+        }
+
+        std::filesystem::path _directory;
+        std::atomic<size_t>   _hits{0};
+        std::atomic<size_t>   _misses{0};
+    };
+
+    namespace detail {
+        inline std::string hex64( uint64_t v ){
+            char buffer[24];
+            std::snprintf( buffer, sizeof(buffer), "0x%016llxull", static_cast<unsigned long long>(v) );
+            return buffer;
+        }
+
+        // string literal with the given bytes, escaping all but plain printable characters
+        inline std::string c_string( std::string_view text ){
+            std::string out = "\"";
+            for( char c : text ){
+                if( c >= ' ' && c <= '~' && c != '"' && c != '\\' && c != '?' ){
+                    out += c;
+                } else {
+                    char escape[8];
+                    std::snprintf( escape, sizeof(escape), "\\%03o", unsigned(static_cast<unsigned char>(c)) );
+                    out += escape;
+                }
+            }
+            return out + "\"";
+        }
+    }
+
+    /**
+     * @brief Generates a self-contained C++ translation unit matching the grammar
+     * Each node becomes a small function that the compiler inlines into its rule, byte sets become
+     * constant bitmaps and literals unrolled compares. The unit exports a peglex_plugin descriptor
+     * under PEGLEX_PLUGIN_SYMBOL and needs no headers beyond the standard library.
+     */
+    inline std::string generate( const Grammar& grammar ){
+        auto nodes = grammar.nodes();
+        auto sets  = grammar.sets();
+        auto rules = grammar.rules();
+        auto bytes = grammar.bytes();
+        auto call  = []( uint32_t n, const char* p ){ return "n" + std::to_string(n) + "( " + p + ", e )"; };
+
+        std::string out = "// generated by peglex::runtime::generate, do not edit\n"
+                          "#include <cstdint>\n\n"
+                          "extern \"C\" {\n"
+                          "    typedef const char* (*peglex_match_fn)( const char* begin, const char* end, void* ctx );\n"
+                          "    struct peglex_plugin { uint32_t abi; uint32_t num_rules; uint64_t key; const peglex_match_fn* rules; const char* const* names; const char* source; uint64_t source_size; };\n"
+                          "}\n\n"
+                          "namespace {\n";
+        for( size_t i=0; i<sets.size(); ++i ){
+            out += "    constexpr uint64_t s" + std::to_string(i) + "[4] = { ";
+            for( int w=0; w<4; ++w ){
+                out += detail::hex64( sets[i][w] ) + (w < 3 ? ", " : " };\n");
+            }
+        }
+        out += "    inline bool in( const uint64_t* s, const char* p, const char* e ){\n"
+               "        if( p == e ){\n"
+               "            return false;\n"
+               "        }\n"
+               "        const unsigned char c = static_cast<unsigned char>(*p);\n"
+               "        return (s[c >> 6] >> (c & 63)) & 1;\n"
+               "    }\n\n";
+        for( size_t i=0; i<nodes.size(); ++i ){
+            out += "    const char* n" + std::to_string(i) + "( const char* p, const char* e );\n";
+        }
+        for( size_t i=0; i<nodes.size(); ++i ){
+            const Node& node = nodes[i];
+            const std::string set = "s" + std::to_string(node.a);
+            out += "\n    inline const char* n" + std::to_string(i) + "( const char* p, const char* e ){\n";
+            switch( node.op ){
+                case Op::Eps:
+                    out += "        return p;\n";
+                    break;
+                case Op::Set:
+                    out += "        return in( " + set + ", p, e ) ? p+1 : nullptr;\n";
+                    break;
+                case Op::Span:
+                    out += "        const char* start = p;\n"
+                           "        while( in( " + set + ", p, e ) ){\n"
+                           "            ++p;\n"
+                           "        }\n"
+                           "        return p-start >= " + std::to_string(node.b) + " ? p : nullptr;\n";
+                    break;
+                case Op::Lit:
+                    // literals hold no NUL, so a terminator mismatches before the compare runs past it
+                    out += "        if( e && e-p < " + std::to_string(node.b) + " ){\n"
+                           "            return nullptr;\n"
+                           "        }\n"
+                           "        return ";
+                    for( uint32_t k=0; k<node.b; ++k ){
+                        out += "p[" + std::to_string(k) + "] == char(" + std::to_string( int(bytes[node.a+k]) ) + ") && ";
+                    }
+                    out += "true ? p+" + std::to_string(node.b) + " : nullptr;\n";
+                    break;
+                case Op::Seq:
+                    for( uint32_t k=0; k<node.b; ++k ){
+                        out += "        if( !(p = " + call( grammar.children()[node.a+k], "p" ) + ") ){\n"
+                               "            return nullptr;\n"
+                               "        }\n";
+                    }
+                    out += "        return p;\n";
+                    break;
+                case Op::Choice:
+                    for( uint32_t k=0; k<node.b; ++k ){
+                        out += "        if( const char* r = " + call( grammar.children()[node.a+k], "p" ) + " ){\n"
+                               "            return r;\n"
+                               "        }\n";
+                    }
+                    out += "        return nullptr;\n";
+                    break;
+                case Op::Plus:
+                    out += "        if( !(p = " + call( node.a, "p" ) + ") ){\n"
+                           "            return nullptr;\n"
+                           "        }\n";
+                    [[fallthrough]];
+                case Op::Star:
+                    out += "        while( const char* r = " + call( node.a, "p" ) + " ){\n"
+                           "            if( r == p ){\n"
+                           "                break;\n"
+                           "            }\n"
+                           "            p = r;\n"
+                           "        }\n"
+                           "        return p;\n";
+                    break;
+                case Op::Maybe:
+                    out += "        const char* r = " + call( node.a, "p" ) + ";\n"
+                           "        return r ? r : p;\n";
+                    break;
+                case Op::Not:
+                    out += "        return " + call( node.a, "p" ) + " ? nullptr : p;\n";
+                    break;
+                case Op::Check:
+                    out += "        return " + call( node.a, "p" ) + " ? p : nullptr;\n";
+                    break;
+                case Op::Ref:
+                    out += "        return " + call( rules[node.a].node, "p" ) + ";\n";
+                    break;
+            }
+            out += "    }\n";
+        }
+        out += "\n";
+        std::string entries, names;
+        for( size_t i=0; i<rules.size(); ++i ){
+            out += "    const char* r" + std::to_string(i) + "( const char* begin, const char* end, void* ){\n"
+                   "        return begin ? n" + std::to_string(rules[i].node) + "( begin, end ) : nullptr;\n"
+                   "    }\n";
+            entries += " r" + std::to_string(i) + ",";
+            names   += " \"" + std::string( grammar.name( uint32_t(i) ) ) + "\",";
+        }
+        out += "    const peglex_match_fn rules[] = {" + entries + " };\n"
+               "    const char* const names[] = {" + names + " };\n"
+               "    const char source[] = " + detail::c_string( grammar.source() ) + ";\n"
+               "}\n\n"
+               "extern \"C\" __attribute__((visibility(\"default\"))) const peglex_plugin " PEGLEX_PLUGIN_SYMBOL " = { "
+             + std::to_string(format_version) + ", " + std::to_string(rules.size()) + ", " + detail::hex64( grammar.key() ) + ", rules, names, source, "
+             + std::to_string(grammar.source().size()) + " };\n";
+        return out;
+    }
+
+#ifdef PEGLEX_HAS_DLOPEN
+    namespace detail {
+        // splits a command line at whitespace, without any shell quoting rules
+        inline std::vector<std::string> words( std::string_view text ){
+            std::vector<std::string> out;
+            size_t pos = 0;
+            while( (pos = text.find_first_not_of( " \t\n", pos )) != std::string_view::npos ){
+                const size_t end = std::min( text.find_first_of( " \t\n", pos ), text.size() );
+                out.emplace_back( text.substr( pos, end-pos ) );
+                pos = end;
+            }
+            return out;
+        }
+
+        // runs args[0], looked up in PATH, with args as its argument vector and waits for it
+        inline bool run( const std::vector<std::string>& args ){
+            if( args.empty() ){
+                return false;
+            }
+            std::vector<char*> argv;
+            for( const std::string& arg : args ){
+                argv.push_back( const_cast<char*>( arg.c_str() ) );
+            }
+            argv.push_back( nullptr );
+            pid_t pid;
+            if( ::posix_spawnp( &pid, argv[0], nullptr, nullptr, argv.data(), environ ) != 0 ){
+                return false;
+            }
+            int status = 0;
+            while( ::waitpid( pid, &status, 0 ) < 0 ){
+                if( errno != EINTR ){
+                    return false;
+                }
+            }
+            return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+    }
+
+    /**
+     * @brief PluginRule, one entry point of a loaded plugin as a Pattern, keeps the library loaded
+     */
+    class PluginRule : public Pattern {
+        public:
+        std::optional<const char*> match( const char* src ) const override {
+            if( const char* ret = _fn( src, nullptr, nullptr ) ){
+                return ret;
+            }
+            return std::nullopt;
+        }
+
+        peglex_match_fn entry() const { return _fn; }
+
+        private:
+        friend class Plugin;
+        PluginRule( std::shared_ptr<void> library, peglex_match_fn fn ) : _library{std::move(library)}, _fn{fn} {}
+        std::shared_ptr<void> _library;
+        peglex_match_fn       _fn;
+    };
+
+    /**
+     * @brief Plugin, a grammar compiled ahead of time to a shared object and loaded with dlopen
+     * build() writes generate(grammar) to <directory>/<key>.cpp, compiles it to <key>.so with the given
+     * compiler command and loads it; an existing library for the same key is reused. The library stays
+     * loaded while the Plugin or any of its rules are alive.
+     */
+    class Plugin {
+        public:
+        static Plugin load( const std::filesystem::path& path ){
+            void* handle = ::dlopen( path.c_str(), RTLD_NOW | RTLD_LOCAL );
+            if( !handle ){
+                throw std::runtime_error("Error: could not load grammar plugin.");
+            }
+            std::shared_ptr<void> library( handle, []( void* h ){ ::dlclose( h ); } );
+            auto info = static_cast<const peglex_plugin*>( ::dlsym( handle, PEGLEX_PLUGIN_SYMBOL ) );
+            if( !info || info->abi != format_version ){
+                throw std::runtime_error("Error: not a compatible grammar plugin.");
+            }
+            return Plugin( std::move(library), info );
+        }
+
+        // compiler is split at whitespace into the program and its leading arguments and run
+        // without a shell; an existing library is reused if it was built from the same source
+        static Plugin build( const Grammar& grammar, const std::filesystem::path& directory, const std::string& compiler="c++ -O2" ){
+            std::filesystem::create_directories( directory );
+            char stem[24];
+            std::snprintf( stem, sizeof(stem), "%016llx", static_cast<unsigned long long>(grammar.key()) );
+            const std::filesystem::path library = directory / (std::string(stem)+".so");
+            if( std::filesystem::exists( library ) ){
+                try {
+                    if( Plugin plugin = load( library ); plugin.key() == grammar.key() && plugin.source() == grammar.source() ){
+                        return plugin;
+                    }
+                } catch( const std::runtime_error& ){
+                    // rebuilt below
+                }
+            }
+            // both outputs are written under unique names and renamed into place when complete
+            const std::string unique = std::string(stem) + ".tmp" + std::to_string( std::random_device{}() );
+            const std::filesystem::path source = directory / (unique+".cpp");
+            const std::filesystem::path tmp    = directory / (unique+".so");
+            std::error_code ec;
+            auto fail = [&]( const char* message ){
+                std::filesystem::remove( source, ec );
+                std::filesystem::remove( tmp, ec );
+                return std::runtime_error( message );
+            };
+            {
+                const std::string code = generate( grammar );
+                std::FILE* fp = std::fopen( source.string().c_str(), "wb" );
+                bool ok = fp && std::fwrite( code.data(), 1, code.size(), fp ) == code.size();
+                if( fp ){
+                    ok = std::fclose( fp ) == 0 && ok;
+                }
+                if( !ok ){
+                    throw fail("Error: could not write grammar plugin source.");
+                }
+            }
+            std::vector<std::string> args = detail::words( compiler );
+            for( const char* arg : { "-std=c++17", "-shared", "-fPIC", "-o" } ){
+                args.push_back( arg );
+            }
+            args.push_back( tmp.string() );
+            args.push_back( source.string() );
+            if( !detail::run( args ) ){
+                throw fail("Error: could not compile grammar plugin.");
+            }
+            std::filesystem::rename( tmp, library, ec );
+            if( ec ){
+                throw fail("Error: could not install grammar plugin.");
+            }
+            std::filesystem::rename( source, directory / (std::string(stem)+".cpp"), ec );
+            return load( library );
+        }
+
+        uint64_t key() const { return _info->key; }
+        size_t size() const { return _info->num_rules; }
+        std::string_view source() const { return std::string_view( _info->source, _info->source_size ); }
+        std::string_view name( uint32_t rule ) const { return _info->names[rule]; }
+
+        PluginRule rule( uint32_t index=0 ) const {
+            if( index >= _info->num_rules ){
+                throw std::runtime_error("Error: rule index out of range.");
+            }
+            return PluginRule( _library, _info->rules[index] );
+        }
+
+        PluginRule rule( std::string_view name ) const {
+            for( uint32_t i=0; i<_info->num_rules; ++i ){
+                if( this->name(i) == name ){
+                    return rule( i );
+                }
+            }
+            throw std::runtime_error("Error: no rule with that name.");
+        }
+
+        // matches [begin,end) with the given rule, end may be null for NUL terminated input
+        std::optional<const char*> match( const char* begin, const char* end=nullptr, uint32_t rule=0, void* ctx=nullptr ) const {
+            if( const char* ret = rule < _info->num_rules ? _info->rules[rule]( begin, end, ctx ) : nullptr ){
+                return ret;
+            }
+            return std::nullopt;
+        }
+
+        private:
+        Plugin( std::shared_ptr<void> library, const peglex_plugin* info ) : _library{std::move(library)}, _info{info} {}
+        std::shared_ptr<void> _library;
+        const peglex_plugin*  _info;
+    };
+#endif
+
+    /**
+     * @brief TieredGrammar, interprets rules until they get hot and then runs them as native code
+     * Calls of an interpreted rule are counted, including references from other rules. The call that
+     * reaches threshold hands the rule to the compiler hook on a background thread. The rule keeps
+     * running in the interpreter meanwhile, and later calls, also those from interpreted rules, go to
+     * the returned entry point. A hook that returns null or throws leaves the rule interpreted. The
+     * first verify native calls of each rule are checked against the interpreter; a disagreement or
+     * deoptimize() sends the rule back to the interpreter for good. Native calls are counted per rule
+     * so that deoptimize() can wait for them to leave. wait() and the destructor block until pending
+     * compilations have finished.
+     */
+    class TieredGrammar {
+        public:
+        // returns a native entry point for a rule, or null; may be called concurrently for different rules
+        using Compiler = std::function<peglex_match_fn( const Grammar&, uint32_t )>;
+
+        enum class Tier : uint8_t { Interpreted, Compiling, Native, Deoptimized };
+
+        TieredGrammar( Grammar grammar, Compiler compiler, uint64_t threshold=1000, uint64_t verify=16 )
+            : _grammar{std::move(grammar)}, _compiler{std::move(compiler)}, _threshold{std::max<uint64_t>( threshold, 1 )}, _verify{verify}, _rules( _grammar.rules().size() ) {}
+
+        TieredGrammar( const TieredGrammar& ) = delete;
+        TieredGrammar& operator=( const TieredGrammar& ) = delete;
+
+        ~TieredGrammar(){
+            wait();
+        }
+
+        /**
+         * @brief TieredRule, one rule of a TieredGrammar as a Pattern, the grammar must outlive it
+         */
+        class TieredRule : public Pattern {
+            public:
+            TieredRule( TieredGrammar& grammar, uint32_t index ) : _grammar{grammar}, _index{index} {}
+            std::optional<const char*> match( const char* src ) const override {
+                return _grammar.match( src, _index );
+            }
+            TieredGrammar& _grammar;
+            uint32_t       _index;
+        };
+
+        std::optional<const char*> match( const char* src, uint32_t rule=0 ){
+            if( rule >= _rules.size() ){
+                throw std::runtime_error("Error: rule index out of range.");
+            }
+            if( const char* ret = src ? call( rule, src ) : nullptr ){
+                return ret;
+            }
+            return std::nullopt;
+        }
+
+        TieredRule rule( uint32_t index=0 ){
+            return TieredRule( *this, _grammar.rule( index ).index() );
+        }
+
+        TieredRule rule( std::string_view name ){
+            return TieredRule( *this, _grammar.rule( name ).index() );
+        }
+
+        // the rule keeps running in the interpreter, e.g. before the code behind its entry point goes away;
+        // returns once no thread is still running that code
+        void deoptimize( uint32_t rule ){
+            State& state = _rules[rule];
+            {
+                std::lock_guard lock( _mutex );
+                state.native.store( nullptr );
+                state.tier.store( Tier::Deoptimized );
+            }
+            while( state.running.load() != 0 ){
+                std::this_thread::yield();
+            }
+        }
+
+        // blocks until the compiler hook has returned for every rule handed to it so far
+        void wait(){
+            while( true ){
+                std::vector<std::thread> workers;
+                {
+                    std::lock_guard lock( _mutex );
+                    workers.swap( _workers );
+                }
+                if( workers.empty() ){
+                    return;
+                }
+                for( std::thread& worker : workers ){
+                    worker.join();
+                }
+            }
+        }
+
+        Tier tier( uint32_t rule ) const { return _rules[rule].tier.load( std::memory_order_relaxed ); }
+        // calls made while the rule was interpreted, counting stops once it is handed to the compiler
+        uint64_t calls( uint32_t rule ) const { return _rules[rule].calls.load( std::memory_order_relaxed ); }
+        const Grammar& grammar() const { return _grammar; }
+
+        private:
+        // one cache line per rule so that counting hot rules does not contend with their neighbours
+        struct alignas(64) State {
+            std::atomic<uint64_t>        calls{0};
+            std::atomic<uint64_t>        checked{0};
+            std::atomic<peglex_match_fn> native{nullptr};
+            std::atomic<Tier>            tier{Tier::Interpreted};
+            std::atomic<uint32_t>        running{0};    // threads inside native, deoptimize() waits for them
+        };
+
+        // runs the native entry point unless the rule has none (anymore)
+        static std::optional<const char*> run_native( State& state, const char* p ){
+            state.running.fetch_add( 1 );
+            std::optional<const char*> ret;
+            if( peglex_match_fn fn = state.native.load() ){
+                ret = fn( p, nullptr, nullptr );
+            }
+            state.running.fetch_sub( 1, std::memory_order_release );
+            return ret;
+        }
+
+        const char* call( uint32_t rule, const char* p ){
+            State& state = _rules[rule];
+            if( state.native.load( std::memory_order_relaxed ) ){
+                if( state.checked.load( std::memory_order_relaxed ) >= _verify || state.checked.fetch_add( 1, std::memory_order_relaxed ) >= _verify ){
+                    if( auto ret = run_native( state, p ) ){
+                        return *ret;
+                    }
+                } else {
+                    const char* expected = interpret( rule, p );
+                    if( auto ret = run_native( state, p ) ; ret && *ret != expected ){
+                        deoptimize( rule );
+                    }
+                    return expected;
+                }
+            }
+            if( state.tier.load( std::memory_order_relaxed ) == Tier::Interpreted && state.calls.fetch_add( 1, std::memory_order_relaxed )+1 >= _threshold ){
+                promote( rule );
+            }
+            return interpret( rule, p );
+        }
+
+        const char* interpret( uint32_t rule, const char* p ){
+            const detail::Program& program = *_grammar._program;
+            return program.eval( program.rules[rule].node, p, [this]( uint32_t r, const char* q ){ return call( r, q ); } );
+        }
+
+        // exactly one caller moves a rule out of the interpreted tier and starts its compilation
+        void promote( uint32_t rule ){
+            Tier expected = Tier::Interpreted;
+            if( !_rules[rule].tier.compare_exchange_strong( expected, Tier::Compiling ) ){
+                return;
+            }
+            std::lock_guard lock( _mutex );
+            try {
+                _workers.emplace_back( [this,rule]{ compile( rule ); } );
+            } catch( ... ){
+                _rules[rule].tier.store( Tier::Deoptimized );
+            }
+        }
+
+        void compile( uint32_t rule ){
+            peglex_match_fn fn = nullptr;
+            try {
+                fn = _compiler ? _compiler( _grammar, rule ) : nullptr;
+            } catch( ... ){
+                fn = nullptr;
+            }
+            // a rule deoptimized while compiling stays deoptimized
+            std::lock_guard lock( _mutex );
+            State& state = _rules[rule];
+            if( state.tier.load() == Tier::Compiling ){
+                state.native.store( fn, std::memory_order_release );
+                state.tier.store( fn ? Tier::Native : Tier::Deoptimized );
+            }
+        }
+
+        Grammar                  _grammar;
+        Compiler                 _compiler;
+        uint64_t                 _threshold;
+        uint64_t                 _verify;
+        std::vector<State>       _rules;
+        std::mutex               _mutex;
+        std::vector<std::thread> _workers;
+    };
+
+#ifdef PEGLEX_HAS_DLOPEN
+    // TieredGrammar compiler hook that builds the whole grammar as one Plugin on first use
+    inline TieredGrammar::Compiler plugin_compiler( std::filesystem::path directory, std::string compiler="c++ -O2" ){
+        struct Shared {
+            std::mutex            mutex;
+            std::optional<Plugin> plugin;
+            bool                  failed = false;
+        };
+        auto shared = std::make_shared<Shared>();
+        return [shared,directory,compiler]( const Grammar& grammar, uint32_t rule ) -> peglex_match_fn {
+            std::lock_guard lock( shared->mutex );
+            if( !shared->plugin && !shared->failed ){
+                try {
+                    shared->plugin = Plugin::build( grammar, directory, compiler );
+                } catch( ... ){
+                    shared->failed = true;
+                }
+            }
+            return shared->plugin ? shared->plugin->rule( rule ).entry() : nullptr;
+        };
+    }
+#endif
+};
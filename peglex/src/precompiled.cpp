@@ -0,0 +1,18 @@
+// (c) James Gregson 2024, MIT license
+
+// instantiates the node types of the convenience definitions for the peglex_precompiled library
+#define PEGLEX_PRECOMPILED_DEFINE
+#include <peglex/peglex.h>
+
+#include <type_traits>
+
+namespace peglex {
+    // keeps the instantiation list in peglex.h in step with the helper definitions
+    static_assert( std::is_same_v< decltype(whitespace()), Or<Or<Or<Char,Char>,Char>,Char> > );
+    static_assert( std::is_same_v< decltype(hex()),        Or<Or<Range,Range>,Range> > );
+    static_assert( std::is_same_v< decltype(alphanum()),   Or<Or<Range,Range>,Range> > );
+    static_assert( std::is_same_v< decltype(digits()),     And<Range,ZeroPlus<Range>> > );
+    static_assert( std::is_same_v< decltype(integer()),    And<Or<Or<Char,Char>,Eps>,And<Range,ZeroPlus<Range>>> > );
+    static_assert( std::is_same_v< decltype(real()),
+        And<And<And<And<Or<Or<Char,Char>,Eps>,And<Range,ZeroPlus<Range>>>,Char>,Or<And<Range,ZeroPlus<Range>>,Eps>>,Or<And<And<Or<Char,Char>,Or<Or<Char,Char>,Eps>>,And<Range,ZeroPlus<Range>>>,Eps>> > );
+};
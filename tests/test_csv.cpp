@@ -0,0 +1,90 @@
+#include <peglex/csv.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace peglex;
+
+namespace {
+    // collects records as vectors of unescaped fields
+    struct TableHandler {
+        void field( std::string_view s, bool quoted ){
+            std::string tmp;
+            if( quoted ){
+                csv::unescape( s, tmp );
+            } else {
+                tmp = s;
+            }
+            row.push_back( tmp );
+        }
+        void end_record(){
+            rows.push_back( row );
+            row.clear();
+        }
+        std::vector<std::string> row;
+        std::vector<std::vector<std::string>> rows;
+    };
+}
+
+TEST_CASE("CsvDocument_works","[Csv Tests]"){
+    TableHandler handler;
+    const char* text = "a,b,c\r\n1,\"x, \"\"y\"\"\",\n\"multi\nline\",,3";
+    REQUIRE( csv::document( handler ).match(text).has_value() );
+    REQUIRE( handler.rows == std::vector<std::vector<std::string>>{
+        {"a","b","c"},
+        {"1","x, \"y\"",""},
+        {"multi\nline","","3"}
+    });
+
+    // alternate delimiters
+    TableHandler tabs;
+    REQUIRE( csv::document( tabs, '\t' ).match("a\tb,c\n").has_value() );
+    REQUIRE( tabs.rows == std::vector<std::vector<std::string>>{ {"a","b,c"} } );
+
+    // stray and unterminated quotes are rejected
+    TableHandler bad;
+    REQUIRE( !csv::document( bad ).match("a,b\"c\n").has_value() );
+    REQUIRE( !csv::document( bad ).match("a,\"bc\n").has_value() );
+    REQUIRE( !csv::document( bad ).match("a,\"b\"c\n").has_value() );
+
+    // padded buffers take the dispatched scanning kernels and must agree
+    TableHandler padded;
+    PaddedBuffer buffer( text );
+    REQUIRE( buffer.match( csv::document( padded ) ).has_value() );
+    REQUIRE( padded.rows == handler.rows );
+}
+
+TEST_CASE("CsvSplit_works","[Csv Tests]"){
+    // quoted line breaks and delimiters near the nominal split points must not start chunks
+    std::string text;
+    for( int i=0; i<200; ++i ){
+        text += std::to_string(i) + ",\"quoted\n\"\"field\"\"\n" + std::to_string(i) + "\",plain\n";
+    }
+
+    TableHandler whole;
+    REQUIRE( csv::document( whole ).match( text.c_str() ).has_value() );
+
+    for( size_t n : {1, 2, 3, 7, 64} ){
+        auto bounds = csv::split( text.data(), text.data()+text.size(), n );
+        REQUIRE( bounds.front() == text.data() );
+        REQUIRE( bounds.back() == text.data()+text.size() );
+        REQUIRE( bounds.size() <= n+1 );
+
+        TableHandler chunked;
+        for( size_t i=0; i+1<bounds.size(); ++i ){
+            REQUIRE( csv::parse_chunk( bounds[i], bounds[i+1], chunked ) );
+        }
+        REQUIRE( chunked.rows == whole.rows );
+
+        // the structural index gives the same boundaries
+        PaddedBuffer buffer( text );
+        StructuralIndex index( buffer, "\"\n" );
+        auto indexed = csv::split( index, n );
+        REQUIRE( indexed.size() == bounds.size() );
+        for( size_t i=0; i<bounds.size(); ++i ){
+            REQUIRE( indexed[i]-buffer.data() == bounds[i]-text.data() );
+        }
+    }
+}
@@ -0,0 +1,87 @@
+#include <peglex/http.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+
+using namespace peglex;
+
+TEST_CASE("HttpRequest_works","[Http Tests]"){
+    const std::string text = "GET /index.html?q=1 HTTP/1.1\r\nHost: example.com\r\nAccept:  text/html \t\r\nX-Empty:\r\n\r\nbody";
+
+    http::Request req;
+    auto res = http::parse_request( text.data(), text.size(), req );
+    REQUIRE( res.status == http::Status::Complete );
+    REQUIRE( res.consumed == text.size()-4 );
+    REQUIRE( req.method == "GET" );
+    REQUIRE( req.target == "/index.html?q=1" );
+    REQUIRE( req.version_major == 1 );
+    REQUIRE( req.version_minor == 1 );
+    REQUIRE( req.num_headers == 3 );
+    REQUIRE( req.header("host")->value == "example.com" );
+    REQUIRE( req.header("ACCEPT")->value == "text/html" );
+    REQUIRE( req.header("x-empty")->value.empty() );
+    REQUIRE( req.header("Content-Length") == nullptr );
+
+    // only letters compare case-insensitively
+    REQUIRE( http::iequals( "X-Caret^", "x-CARET^" ) );
+    REQUIRE( !http::iequals( "X-Caret^", "X-Caret~" ) );
+    REQUIRE( !http::iequals( "@", "`" ) );
+    REQUIRE( !http::iequals( "[", "{" ) );
+
+    // every proper prefix of the head is incomplete, none of them are NUL terminated
+    for( size_t n=0; n<res.consumed; ++n ){
+        std::string prefix = text.substr(0,n);
+        REQUIRE( http::parse_request( prefix.data(), n, req ).status == http::Status::Incomplete );
+    }
+
+    // trickled input resumes the search where the previous attempt stopped
+    std::string trickle;
+    http::Result partial{ http::Status::Incomplete };
+    for( size_t n=0; n<text.size() && partial.status == http::Status::Incomplete; ++n ){
+        trickle.push_back( text[n] );
+        partial = http::parse_request( trickle.data(), trickle.size(), req, trickle.size()-1 );
+    }
+    REQUIRE( partial.status == http::Status::Complete );
+    REQUIRE( partial.consumed == res.consumed );
+    REQUIRE( req.header("accept")->value == "text/html" );
+
+    // bare line feeds are tolerated
+    const std::string lf = "POST / HTTP/1.0\nA: b\n\n";
+    REQUIRE( http::parse_request( lf.data(), lf.size(), req ).status == http::Status::Complete );
+    REQUIRE( req.header("a")->value == "b" );
+
+    for( std::string bad : { "GET  / HTTP/1.1\r\n\r\n", "GET / HTTP/1.1\r\nBad Name: x\r\n\r\n", "GET / HTTP/1.1\r\n folded\r\n\r\n", "GET / HTTP/11\r\n\r\n" } ){
+        REQUIRE( http::parse_request( bad.data(), bad.size(), req ).status == http::Status::Error );
+    }
+}
+
+TEST_CASE("HttpChunked_works","[Http Tests]"){
+    const std::string wire = "4\r\nWiki\r\n6;ext=1\r\npedia \r\nE\r\nin \r\n\r\nchunks.\r\n0\r\nTrailer: x\r\n\r\nNEXT";
+
+    // feed the message in every split to exercise incremental decoding
+    for( size_t split=0; split<=wire.size(); ++split ){
+        http::ChunkedDecoder decoder;
+        std::string payload;
+
+        std::string first = wire.substr(0,split);
+        size_t len = first.size();
+        auto res = decoder.decode( first.data(), len );
+        payload.append( first.data(), len );
+        if( res.status == http::Status::Incomplete ){
+            std::string second = wire.substr(split);
+            len = second.size();
+            res = decoder.decode( second.data(), len );
+            payload.append( second.data(), len );
+            REQUIRE( second.substr(res.consumed) == "NEXT" );
+        }
+        REQUIRE( res.status == http::Status::Complete );
+        REQUIRE( decoder.done() );
+        REQUIRE( payload == "Wikipedia in \r\n\r\nchunks." );
+    }
+
+    http::ChunkedDecoder bad;
+    std::string garbage = "zz\r\n";
+    size_t len = garbage.size();
+    REQUIRE( bad.decode( garbage.data(), len ).status == http::Status::Error );
+}
@@ -0,0 +1,84 @@
+#include <peglex/json.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace peglex;
+
+namespace {
+    // records events as a flat token list for easy comparison
+    struct RecordingHandler {
+        void null_value(){ events.push_back("null"); }
+        void boolean( bool b ){ events.push_back( b ? "true" : "false" ); }
+        void number( std::string_view s ){ events.push_back( "n:" + std::string(s) ); }
+        void string( std::string_view s ){ events.push_back( "s:" + std::string(s) ); }
+        void key( std::string_view s ){ events.push_back( "k:" + std::string(s) ); }
+        void start_object(){ events.push_back("{"); }
+        void end_object(){ events.push_back("}"); }
+        void start_array(){ events.push_back("["); }
+        void end_array(){ events.push_back("]"); }
+        std::vector<std::string> events;
+    };
+}
+
+TEST_CASE("JsonDocument_works","[Json Tests]"){
+    RecordingHandler handler;
+    auto parser = json::document( handler );
+
+    REQUIRE( parser.match(R"( {"a": [1, -2.5e3, true, null], "b\"c": {"d": "x\ny"}, "e": []} )").has_value() );
+    REQUIRE( handler.events == std::vector<std::string>{
+        "{", "k:a", "[", "n:1", "n:-2.5e3", "true", "null", "]",
+        "k:b\\\"c", "{", "k:d", "s:x\\ny", "}", "k:e", "[", "]", "}"
+    });
+}
+
+TEST_CASE("JsonValidate_works","[Json Tests]"){
+    REQUIRE( json::validate("0") );
+    REQUIRE( json::validate(" \"\\u00e9\" ") );
+    REQUIRE( json::validate("[[[]], {}, -0.0E+1]") );
+
+    REQUIRE( !json::validate("") );
+    REQUIRE( !json::validate("01") );
+    REQUIRE( !json::validate("1.") );
+    REQUIRE( !json::validate("[1,]") );
+    REQUIRE( !json::validate("{\"a\" 1}") );
+    REQUIRE( !json::validate("\"tab\there\"") );
+    REQUIRE( !json::validate("\"\\x\"") );
+    REQUIRE( !json::validate("[1] 2") );
+    REQUIRE( !json::validate("tru") );
+
+    // nesting beyond the depth limit fails instead of overflowing the stack
+    json::NullHandler handler;
+    REQUIRE(  json::document( handler, 3 ).match("[[[1]]]").has_value() );
+    REQUIRE( !json::document( handler, 3 ).match("[[[[1]]]]").has_value() );
+}
+
+TEST_CASE("JsonValidator_works","[Json Tests]"){
+    RecordingHandler handler;
+    auto validator = validator_of( json::document( handler ) );
+    static_assert( std::is_same_v< decltype(validator), decltype(json::document( json::null_handler )) > );
+    REQUIRE( validator.match("{\"a\": [1, 2]}").has_value() );
+    REQUIRE( !validator.match("{\"a\": [1, 2}").has_value() );
+    REQUIRE( handler.events.empty() );
+}
+
+TEST_CASE("JsonNdjson_works","[Json Tests]"){
+    RecordingHandler handler;
+    REQUIRE( json::ndjson( handler ).match("{\"a\":1}\r\n[2]\n3").has_value() );
+    REQUIRE( handler.events == std::vector<std::string>{ "{", "k:a", "n:1", "}", "[", "n:2", "]", "n:3" } );
+
+    json::NullHandler null_handler;
+    REQUIRE( !json::ndjson( null_handler ).match("{\"a\":1} {\"b\":2}\n").has_value() );
+}
+
+TEST_CASE("JsonUnescape_works","[Json Tests]"){
+    std::string out;
+    REQUIRE( json::unescape( R"(a\"b\\c\/\n\u00e9\ud83d\ude00)", out ) );
+    REQUIRE( out == "a\"b\\c/\n\xc3\xa9\xf0\x9f\x98\x80" );
+
+    out.clear();
+    REQUIRE( !json::unescape( R"(\ude00)", out ) );
+    REQUIRE( !json::unescape( R"(\u12)", out ) );
+}
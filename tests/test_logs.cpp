@@ -0,0 +1,117 @@
+#include <peglex/logs.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace peglex;
+
+TEST_CASE("CombinedLog_works","[Log Tests]"){
+    logs::CombinedEntry entry;
+    auto parser = logs::combined( entry ) & eof();
+
+    const char* line = R"(127.0.0.1 - frank [10/Oct/2000:13:55:36 -0700] "GET /apache_pb.gif HTTP/1.0" 200 2326 "http://www.example.com/start.html" "Mozilla/4.08 [en] (Win98; I ;Nav) \"quoted\"")";
+    REQUIRE( parser.match(line).has_value() );
+    REQUIRE( entry.host == "127.0.0.1" );
+    REQUIRE( entry.ip_version == 4 );
+    REQUIRE( entry.address[0] == 127 );
+    REQUIRE( entry.address[3] == 1 );
+    REQUIRE( entry.ident == "-" );
+    REQUIRE( entry.user == "frank" );
+    REQUIRE( entry.time == "10/Oct/2000:13:55:36 -0700" );
+    REQUIRE( entry.time_ns == 971211336000000000 );
+    REQUIRE( entry.request == "GET /apache_pb.gif HTTP/1.0" );
+    REQUIRE( entry.method == "GET" );
+    REQUIRE( entry.target == "/apache_pb.gif" );
+    REQUIRE( entry.protocol == "HTTP/1.0" );
+    REQUIRE( entry.status == 200 );
+    REQUIRE( entry.bytes == 2326 );
+    REQUIRE( entry.referer == "http://www.example.com/start.html" );
+    REQUIRE( entry.user_agent == R"(Mozilla/4.08 [en] (Win98; I ;Nav) \"quoted\")" );
+
+    // common log format, garbage request line and '-' for bytes
+    REQUIRE( parser.match(R"(::1 - - [10/Oct/2000:13:55:36 -0700] "\x16\x03" 400 -)").has_value() );
+    REQUIRE( entry.host == "::1" );
+    REQUIRE( entry.ip_version == 6 );
+    REQUIRE( entry.address[15] == 1 );
+    REQUIRE( entry.method.empty() );
+    REQUIRE( entry.status == 400 );
+    REQUIRE( entry.bytes == 0 );
+    REQUIRE( entry.user_agent.empty() );
+
+    REQUIRE( !parser.match(R"(127.0.0.1 - - [10/Oct/2000:13:55:36 -0700] "GET / HTTP/1.1" abc 0)").has_value() );
+
+    // host names are kept as text, malformed times fail
+    REQUIRE( parser.match(R"(1.2.3.4.example.com - - [29/Feb/2024:00:00:00 +0000] "GET / HTTP/1.1" 200 0)").has_value() );
+    REQUIRE( entry.host == "1.2.3.4.example.com" );
+    REQUIRE( entry.ip_version == 0 );
+    REQUIRE( entry.time_ns == 1709164800000000000 );
+    REQUIRE( !parser.match(R"(127.0.0.1 - - [30/Feb/2024:00:00:00 +0000] "GET / HTTP/1.1" 200 0)").has_value() );
+    REQUIRE( !parser.match(R"(127.0.0.1 - - [10/Okt/2000:13:55:36 -0700] "GET / HTTP/1.1" 200 0)").has_value() );
+    REQUIRE( !parser.match(R"(127.0.0.1 - - [10/Oct/2000:13:55:36] "GET / HTTP/1.1" 200 0)").has_value() );
+
+    // the validator leaves the entry alone
+    const std::string_view host = entry.host;
+    auto validator = validator_of( parser );
+    REQUIRE( validator.match(line).has_value() );
+    REQUIRE( !validator.match(R"(127.0.0.1 - - [10/Oct/2000:13:55:36 -0700] "GET / HTTP/1.1" 99999999999 0)").has_value() );
+    REQUIRE( entry.host == host );
+}
+
+TEST_CASE("Syslog_works","[Log Tests]"){
+    logs::SyslogEntry entry;
+    auto parser = logs::syslog( entry ) & eof();
+
+    REQUIRE( parser.match(R"(<165>1 2003-10-11T22:14:15.003Z mymachine.example.com evntslog - ID47 [exampleSDID@32473 iut="3" eventSource="Application \"x\""][examplePriority@32473 class="high"] An application event)").has_value() );
+    REQUIRE( entry.priority == 165 );
+    REQUIRE( entry.facility() == 20 );
+    REQUIRE( entry.severity() == 5 );
+    REQUIRE( entry.version == 1 );
+    REQUIRE( entry.timestamp == "2003-10-11T22:14:15.003Z" );
+    REQUIRE( entry.time_ns == 1065910455003000000 );
+    REQUIRE( entry.hostname == "mymachine.example.com" );
+    REQUIRE( entry.app_name == "evntslog" );
+    REQUIRE( entry.procid.empty() );
+    REQUIRE( entry.msgid == "ID47" );
+    REQUIRE( entry.structured_data == R"([exampleSDID@32473 iut="3" eventSource="Application \"x\""][examplePriority@32473 class="high"])" );
+    REQUIRE( entry.message == "An application event" );
+
+    REQUIRE( parser.match("<34>1 - - su - - -").has_value() );
+    REQUIRE( entry.app_name == "su" );
+    REQUIRE( entry.timestamp.empty() );
+    REQUIRE( entry.message.empty() );
+
+    REQUIRE( !parser.match("<34>0 - - su - - -").has_value() );
+
+    // PRI ranges over 0..191 without leading zeros
+    for( const char* pri : { "0", "7", "19", "99", "100", "189", "190", "191" } ){
+        const std::string line = "<" + std::string(pri) + ">1 - - su - - -";
+        REQUIRE( parser.match( line.c_str() ).has_value() );
+        REQUIRE( entry.priority == std::stoi(pri) );
+    }
+    for( const char* pri : { "999", "192", "200", "034", "00", "" } ){
+        const std::string line = "<" + std::string(pri) + ">1 - - su - - -";
+        REQUIRE( !parser.match( line.c_str() ).has_value() );
+    }
+    REQUIRE( !parser.match("<34>1 2003-13-11T22:14:15Z - su - - -").has_value() );
+    REQUIRE( !parser.match("<34>1 - - su - - [bad").has_value() );
+}
+
+TEST_CASE("Logfmt_works","[Log Tests]"){
+    struct Pairs {
+        void pair( std::string_view k, std::string_view v, bool quoted ){
+            items.push_back( std::string(k) + (quoted ? "=\"" : "=") + std::string(v) );
+        }
+        std::vector<std::string> items;
+    } pairs;
+
+    auto parser = logs::logfmt( pairs ) & newline();
+    REQUIRE( parser.match("at=info method=GET path=/ msg=\"hello \\\"world\\\"\" flag empty= dur=1.5ms\n").has_value() );
+    REQUIRE( pairs.items == std::vector<std::string>{
+        "at=info", "method=GET", "path=/", "msg=\"hello \\\"world\\\"", "flag=", "empty=", "dur=1.5ms"
+    });
+
+    REQUIRE( !parser.match("msg=\"unterminated\n").has_value() );
+    REQUIRE( !parser.match("a=\"b\"c\n").has_value() );
+}
@@ -1,5 +1,11 @@
 #include <peglex/peglex.h>
 
+#include <atomic>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 using Catch::Matchers::WithinAbs;
@@ -59,6 +65,17 @@ TEST_CASE( "Str_works", "[Basic Tests]"){
 
 }
 
+TEST_CASE( "Lit_works", "[Basic Tests]"){
+    REQUIRE(  lit<"abcd">().match("abcdefg").has_value() );
+    REQUIRE( !lit<"abcd">().match("ab").has_value() );
+    REQUIRE( !lit<"abcd">().match("abce").has_value() );
+    REQUIRE( !lit<"abcd">().match("").has_value() );
+
+    const char* src = "while(x)";
+    REQUIRE( *lit<"while">().match(src) == src+5 );
+    REQUIRE( ( lit<"if">() | lit<"while">() & '(' ).match(src).has_value() );
+}
+
 TEST_CASE( "Check_works", "[Basic Tests]"){
     REQUIRE( check(eps()&'a'&'b').match("abcde").has_value() );
     REQUIRE( check("ab").match("abcde").has_value() );
@@ -294,4 +311,777 @@ TEST_CASE("StringCallback_works","[Basic Tests]"){
     }
 
 
-}
\ No newline at end of file
+}
+
+TEST_CASE("Column_works","[Extraction Tests]"){
+    // name, status code and latency columns of a log-like record
+    ColumnBatch< StringColumn, NumericColumn<int>, NumericColumn<double> > batch;
+
+    auto ws     = plus( space() );
+    auto name   = column<0>( batch, plus(alpha()) );
+    auto status = column<1>( batch, digits() );
+    auto millis = column<2>( batch, real() );
+    auto record = row( batch, name & ws & status & maybe( ws & millis ) & newline() );
+
+    REQUIRE( **plus(record).match("get 200 1.5\nput 404\npost 500 12.25\n") == '\0' );
+    REQUIRE( batch.rows() == 3 );
+    REQUIRE( batch.column<0>()[2] == "post" );
+    REQUIRE( batch.column<0>()._offsets == std::pmr::vector<int32_t>{0,3,6,10} );
+    REQUIRE( batch.column<1>()[1] == 404 );
+    REQUIRE_THAT( batch.column<2>()[2], WithinAbs(12.25,1e-12) );
+
+    // missing optional fields are committed as nulls
+    REQUIRE(  batch.column<2>()._validity.valid(0) );
+    REQUIRE( !batch.column<2>()._validity.valid(1) );
+    REQUIRE( batch.column<2>()._validity._null_count == 1 );
+
+    // a failed record rolls back the columns it already appended
+    REQUIRE( !record.match("head 200 oops\n").has_value() );
+    REQUIRE( batch.rows() == 3 );
+    REQUIRE( batch.column<0>().size() == 3 );
+    REQUIRE( batch.column<1>().size() == 3 );
+
+    // values appended by alternatives that fail within a row are taken back at the choice point
+    ColumnBatch< NumericColumn<int>, NumericColumn<int> > pairs;
+    auto entry = row( pairs, maybe( column<0>( pairs, digits() ) & 'x' ) & ( column<0>( pairs, digits() ) & ';' | column<1>( pairs, digits() ) ) & newline() );
+    REQUIRE( **plus(entry).match("12\n5x3\n4;\n") == '\0' );
+    REQUIRE( pairs.rows() == 3 );
+    REQUIRE( pairs.column<0>().size() == 3 );
+    REQUIRE( pairs.column<1>().size() == 3 );
+    REQUIRE( !pairs.column<0>()._validity.valid(0) );
+    REQUIRE( pairs.column<1>()[0] == 12 );
+    REQUIRE( pairs.column<0>()[1] == 5 );
+    REQUIRE( pairs.column<1>()[1] == 3 );
+    REQUIRE( pairs.column<0>()[2] == 4 );
+    REQUIRE( !pairs.column<1>()._validity.valid(2) );
+
+    // a row that fills a column twice fails
+    REQUIRE( !entry.match("5x3;\n").has_value() );
+    REQUIRE( pairs.column<0>().size() == 3 );
+
+    // and so are rows committed by a failed alternative
+    REQUIRE( ( entry & '!' | entry ).match("7\n").has_value() );
+    REQUIRE( pairs.rows() == 4 );
+    REQUIRE( pairs.column<1>().size() == 4 );
+    REQUIRE( pairs.column<1>()[3] == 7 );
+}
+
+namespace {
+    enum class Method { Get, Put, Post };
+    struct Request {
+        Method           method = Method::Get;
+        std::string_view path;
+        int              status = 0;
+        double           millis = 0.0;
+    };
+}
+
+template<>
+struct peglex::Keywords<Method> {
+    static constexpr std::pair<std::string_view,Method> values[] = {
+        {"GET",Method::Get}, {"PUT",Method::Put}, {"POST",Method::Post}
+    };
+};
+
+TEST_CASE("Field_works","[Extraction Tests]"){
+    Request req;
+    auto [method,path,status,millis] = fields<&Request::method,&Request::path,&Request::status,&Request::millis>(req);
+
+    auto ws     = plus( space() );
+    auto parser = method(plus(upper())) & ws & path(plus(!space() & any())) & ws & status(digits()) & ws & millis(real()) & eof();
+
+    const char* line = "POST /api/v1 201 3.5";
+    REQUIRE( parser.match(line).has_value() );
+    REQUIRE( req.method == Method::Post );
+    REQUIRE( req.path == "/api/v1" );
+    REQUIRE( req.path.data() == line+5 );
+    REQUIRE( req.status == 201 );
+    REQUIRE_THAT( req.millis, WithinAbs(3.5,1e-12) );
+
+    // unknown keywords and out of range numbers fail the match
+    REQUIRE( !parser.match("PATCH /api 200 1.0").has_value() );
+    REQUIRE( !field<&Request::status>(req,digits()).match("99999999999").has_value() );
+}
+
+TEST_CASE("Timestamp_works","[Primitive Tests]"){
+    int64_t ns = 0;
+    auto ts = timestamp( [&ns]( int64_t v ){ ns = v; } );
+
+    REQUIRE( **ts.match("1970-01-01T00:00:00Z rest") == ' ' );
+    REQUIRE( ns == 0 );
+    REQUIRE( ts.match("2003-10-11T22:14:15.003Z").has_value() );
+    REQUIRE( ns == 1065910455003000000 );
+    REQUIRE( ts.match("1985-04-12t23:20:50.52z").has_value() );
+    REQUIRE( ns == 482196050520000000 );
+    REQUIRE( ts.match("1996-12-19T16:39:57-08:00").has_value() );
+    REQUIRE( ns == 851042397000000000 );
+    REQUIRE( ts.match("2000-02-29 12:00:00.1234567891+00:00").has_value() );
+    REQUIRE( ns == 951825600123456789 );
+    REQUIRE( ts.match("1969-12-31T23:59:59.5Z").has_value() );
+    REQUIRE( ns == -500000000 );
+
+    REQUIRE( !ts.match("2001-02-29T00:00:00Z").has_value() );
+    REQUIRE( !ts.match("2001-01-01T24:00:00Z").has_value() );
+    REQUIRE( !ts.match("2001-01-01T00:00:00").has_value() );
+    REQUIRE( !ts.match("2001-01-01T00:00:00.Z").has_value() );
+    REQUIRE( !ts.match("2001-01-01T00:00").has_value() );
+}
+
+TEST_CASE("IPv4_works","[Primitive Tests]"){
+    uint32_t addr = 0;
+    auto ip = ipv4( [&addr]( uint32_t v ){ addr = v; } );
+
+    REQUIRE( **ip.match("192.168.0.1:80") == ':' );
+    REQUIRE( addr == 0xC0A80001 );
+    REQUIRE( ip.match("0.0.0.0").has_value() );
+    REQUIRE( ip.match("255.255.255.255").has_value() );
+    REQUIRE( addr == 0xFFFFFFFF );
+
+    REQUIRE( !ip.match("256.0.0.1").has_value() );
+    REQUIRE( !ip.match("01.2.3.4").has_value() );
+    REQUIRE( !ip.match("1.2.3").has_value() );
+    REQUIRE( !ip.match("1.2.3.4567").has_value() );
+}
+
+TEST_CASE("IPv6_works","[Primitive Tests]"){
+    std::array<uint8_t,16> addr{};
+    auto ip = ipv6( [&addr]( const std::array<uint8_t,16>& v ){ addr = v; } );
+
+    REQUIRE( **ip.match("2001:db8::ff00:42:8329 x") == ' ' );
+    REQUIRE( addr == std::array<uint8_t,16>{0x20,0x01,0x0d,0xb8,0,0,0,0,0,0,0xff,0x00,0x00,0x42,0x83,0x29} );
+    REQUIRE( ip.match("::1").has_value() );
+    REQUIRE( addr == std::array<uint8_t,16>{0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1} );
+    REQUIRE( ip.match("::").has_value() );
+    REQUIRE( addr == std::array<uint8_t,16>{} );
+    REQUIRE( ip.match("fe80::").has_value() );
+    REQUIRE( addr[0] == 0xfe );
+    REQUIRE( ip.match("::ffff:192.0.2.128").has_value() );
+    REQUIRE( addr == std::array<uint8_t,16>{0,0,0,0,0,0,0,0,0,0,0xff,0xff,192,0,2,128} );
+    REQUIRE( ip.match("1:2:3:4:5:6:7:8").has_value() );
+    REQUIRE( addr[15] == 8 );
+
+    REQUIRE( !ip.match("1:2:3:4:5:6:7").has_value() );
+    REQUIRE( !ip.match("1::2::3").has_value() );
+    REQUIRE( !ip.match(":1:2:3:4:5:6:7").has_value() );
+    REQUIRE( **ip.match("1:2:3:4:5:6:7:8:9") == ':' );
+    REQUIRE( !ip.match("12345::").has_value() );
+}
+
+TEST_CASE("Uuid_works","[Primitive Tests]"){
+    std::array<uint8_t,16> bytes{};
+    auto id = uuid( [&bytes]( const std::array<uint8_t,16>& v ){ bytes = v; } );
+
+    REQUIRE( id.match("123e4567-e89b-12d3-A456-426614174000").has_value() );
+    REQUIRE( bytes == std::array<uint8_t,16>{0x12,0x3e,0x45,0x67,0xe8,0x9b,0x12,0xd3,0xa4,0x56,0x42,0x66,0x14,0x17,0x40,0x00} );
+    REQUIRE( !id.match("123e4567e89b12d3a456426614174000").has_value() );
+    REQUIRE( !id.match("123e4567-e89b-12d3-a456-42661417400").has_value() );
+}
+
+TEST_CASE("SymbolStack_works","[Symbol Tests]"){
+    SymbolStack<2> tags;
+    UserFnRegistry<int> user_fns;
+
+    // an element is a self-closed tag, or an open tag, nested elements and the matching close tag
+    auto name    = plus( alphanum() );
+    auto element = ( '<' & name & "/>" )
+                 | rollback( tags, '<' & push_capture( tags, name ) & '>' & star( cb( user_fns.cb(0) ) ) & "</" & match_top( tags ) & '>' & pop( tags ) );
+    user_fns.bind( 0, element );
+    auto document = plus( element ) & eof();
+
+    REQUIRE( document.match("<tag1><tag2><tag3/><tag4/></tag2></tag1>").has_value() );
+    REQUIRE( document.match("<a><b><c><d></d></c></b></a><e></e>").has_value() );
+    REQUIRE( tags.empty() );
+    REQUIRE( tags._size == 0 );
+
+    // mismatched and unclosed tags fail, and leave no stale entries behind
+    REQUIRE( !document.match("<tag1><tag2></tag1></tag2>").has_value() );
+    REQUIRE( !document.match("<a><b><c></c></b>").has_value() );
+    REQUIRE( tags.empty() );
+
+    // rollback also undoes pops made by a failed alternative
+    tags.push( "x" );
+    auto popper = rollback( tags, pop( tags ) & 'a' ) | ( match_top( tags ) & 'b' );
+    REQUIRE( **popper.match("xbc") == 'c' );
+    REQUIRE( tags.depth() == 1 );
+    REQUIRE( tags.top() == "x" );
+    tags.clear();
+    REQUIRE( !match_top( tags ).match("x").has_value() );
+    REQUIRE( !pop( tags ).match("x").has_value() );
+
+    // plain choices and repetitions restore the stack too
+    auto either = ( push_capture( tags, alpha() ) & '!' ) | ( push_capture( tags, alpha() ) & '?' );
+    REQUIRE( either.match("a?").has_value() );
+    REQUIRE( tags.depth() == 1 );
+    tags.clear();
+    auto repeated = star( push_capture( tags, alpha() ) & ';' );
+    REQUIRE( **repeated.match("a;b;c") == 'c' );
+    REQUIRE( tags.depth() == 2 );
+    REQUIRE( tags.top() == "b" );
+    auto unwound = star( pop( tags ) & 'x' );
+    REQUIRE( **unwound.match("xy") == 'y' );
+    REQUIRE( tags.depth() == 1 );
+    REQUIRE( tags.top() == "a" );
+    tags.clear();
+
+    // replacing the top inside a choice point keeps storage proportional to depth
+    tags.push( "x" );
+    auto replace = star( rollback( tags, pop( tags ) & push_capture( tags, alpha() ) ) );
+    REQUIRE( **replace.match("abcdefgh1") == '1' );
+    REQUIRE( tags.depth() == 1 );
+    REQUIRE( tags.top() == "h" );
+    REQUIRE( tags._overflow.empty() );
+    REQUIRE( detail::journal.entries.empty() );
+}
+
+TEST_CASE("PmrAllocation_works","[Allocator Tests]"){
+    // every allocation must come from the arena, the upstream resource throws
+    std::array<std::byte,16384> buffer;
+    std::pmr::monotonic_buffer_resource arena( buffer.data(), buffer.size(), std::pmr::null_memory_resource() );
+
+    std::pmr::vector<std::pmr::string> words( &arena );
+    auto word   = cb( plus( alpha() ), &arena, [&words]( const std::pmr::string& s ){ words.push_back( s ); } );
+    auto parser = plus( word & star( space() ) );
+    REQUIRE( parser.match("a reasonably long sentence with words exceeding the small string buffer incomprehensibilities").has_value() );
+    REQUIRE( words.back() == "incomprehensibilities" );
+
+    ColumnBatch< StringColumn, NumericColumn<int> > batch( &arena );
+    auto record = row( batch, column<0>( batch, plus(alpha()) ) & ',' & column<1>( batch, digits() ) & newline() );
+    REQUIRE( plus(record).match("alpha,1\nbeta,22\ngamma,333\n").has_value() );
+    REQUIRE( batch.rows() == 3 );
+
+    SymbolStack<1> tags( &arena );
+    auto nested = plus( push_capture( tags, alpha() ) ) & '-' & plus( match_top( tags ) & pop( tags ) );
+    REQUIRE( nested.match("abcd-dcba").has_value() );
+    REQUIRE( tags.empty() );
+
+    UserFnRegistry<int> user_fns( &arena );
+    auto expr = plus( 'a' | ( '(' & cb( user_fns.cb(0) ) & ')' ) );
+    user_fns.bind( 0, expr );
+    REQUIRE( **expr.match("a(a(aa))b") == 'b' );
+}
+
+TEST_CASE("Validator_works","[Validator Tests]"){
+    int calls = 0;
+    Request req;
+    ColumnBatch< StringColumn, NumericColumn<uint8_t> > batch;
+
+    auto counted = [&calls]( const std::string& ){ ++calls; };
+    auto ident   = cb( alpha() & star( alphanum() ), counted );
+    auto number  = row( batch, column<0>( batch, ident ) & '=' & column<1>( batch, digits() ) );
+    auto grammar = cb( number & star( ',' & number ), [&calls]{ ++calls; } ) & maybe( ';' & field<&Request::method>( req, plus(upper()) ) ) & eof();
+
+    auto validator = validator_of( grammar );
+    static_assert( std::is_same_v< validator_t<decltype(grammar)>, decltype(validator) > );
+    static_assert( std::is_same_v< decltype(validator_of( ident )), decltype( alpha() & star( alphanum() ) ) > );
+
+    // same language, no side effects
+    for( const char* text : { "a=1,b2=255;GET", "a=1", "a=256", "a=1;PATCH", "1=1", "a=1,", "" } ){
+        REQUIRE( validator.match(text).has_value() == grammar.match(text).has_value() );
+    }
+    calls = 0;
+    batch.truncate(0);
+    REQUIRE( validator.match("a=1,b2=255;POST").has_value() );
+    REQUIRE( calls == 0 );
+    REQUIRE( batch.rows() == 0 );
+    REQUIRE( req.method == Method::Get );
+
+    // typed primitives lose their callbacks
+    int64_t ns = -1;
+    auto ts = validator_of( timestamp( [&ns]( int64_t v ){ ns = v; } ) );
+    REQUIRE( ts.match("1970-01-01T00:00:00Z").has_value() );
+    REQUIRE( ns == -1 );
+
+    // recursion through a registry reaches the bound expression's validator
+    int fired = 0;
+    UserFnRegistry<int> user_fns;
+    auto expr = cb( plus( digit() ), [&fired]{ ++fired; } ) | ( '(' & cb( user_fns.cb(0) ) & ')' );
+    user_fns.bind( 0, expr );
+    auto nested = validator_of( expr );
+    REQUIRE( **nested.match("((42))x") == 'x' );
+    REQUIRE( !nested.match("((42)").has_value() );
+    REQUIRE( fired == 0 );
+    REQUIRE( expr.match("((42))").has_value() );
+    REQUIRE( fired == 1 );
+
+    // plain user functions need an explicit validator
+    auto plain = cb( [&fired]( const char* src ) -> std::optional<const char*> { ++fired; return src; } );
+    REQUIRE_THROWS( validator_of( plain ) );
+    auto given = validator_of( cb( plain._fn, []( const char* src ) -> std::optional<const char*> { return src; } ) );
+    REQUIRE( given.match("x").has_value() );
+    REQUIRE( fired == 1 );
+
+    // type-erased rules forward to the rule they hold
+    AnyRule erased( expr );
+    REQUIRE( validator_of( erased ).match("(7)").has_value() );
+    REQUIRE( !validator_of( erased ).match("()").has_value() );
+    REQUIRE( fired == 1 );
+
+    // symbol stacks are per thread and never the caller's
+    SymbolStack<> tags;
+    auto balanced = rollback( tags, push_capture( tags, plus( alpha() ) ) & '-' & match_top( tags ) & pop( tags ) );
+    auto checker  = validator_of( balanced );
+    static_assert( std::is_same_v< decltype(validator_of( checker )), decltype(checker) > );
+    tags.push( "stale" );
+    std::vector<std::thread> threads;
+    std::atomic<int> passed = 0;
+    for( int t=0; t<4; ++t ){
+        threads.emplace_back( [&]{
+            for( int i=0; i<1000; ++i ){
+                passed += checker.match("abc-abc").has_value() && !checker.match("abc-abd").has_value();
+            }
+            passed += ThreadStack( tags ).empty() ? 0 : -1;
+        } );
+    }
+    for( auto& thread : threads ){
+        thread.join();
+    }
+    REQUIRE( passed == 4000 );
+    REQUIRE( tags.depth() == 1 );
+    REQUIRE( tags.top() == "stale" );
+}
+
+TEST_CASE("PaddedBuffer_works","[Buffer Tests]"){
+    PaddedBuffer buffer( std::string("GET /index.html HTTP/1.1") );
+    REQUIRE( buffer.size() == 24 );
+    REQUIRE( reinterpret_cast<uintptr_t>(buffer.data()) % PaddedBuffer::alignment == 0 );
+    REQUIRE( buffer.data()[buffer.size()] == '\0' );
+
+    auto request = lit<"GET">() & ' ' & until(' ') & ' ' & lit<"HTTP/1.1">() & eof();
+    auto ret = buffer.match( request );
+    REQUIRE( ret.has_value() );
+    REQUIRE( *ret == buffer.data()+buffer.size() );
+    REQUIRE( !buffer.match( lit<"GET /index.html HTTP/1.1 and more">() ).has_value() );
+    REQUIRE( !buffer.match( lit<"GET /index.html HTTP/1.2">() ).has_value() );
+    REQUIRE( !detail::padded( buffer.data() ) );
+
+    // the same literal at the very end of the buffer
+    {
+        PaddedScope scope( buffer );
+        REQUIRE( detail::padded( buffer.data()+buffer.size() ) );
+        REQUIRE( *lit<"1.1">().match( buffer.data()+21 ) == buffer.data()+24 );
+        REQUIRE( !lit<"1.1 ">().match( buffer.data()+21 ).has_value() );
+    }
+
+    const std::string temp = ( std::filesystem::temp_directory_path() / ("peglex_padded_buffer_" + std::to_string( std::random_device{}() ) + ".txt") ).string();
+    const char* path = temp.c_str();
+    std::FILE* fp = std::fopen( path, "wb" );
+    std::fputs( "key=value", fp );
+    std::fclose( fp );
+    auto file = PaddedBuffer::from_file( path );
+    REQUIRE( file.view() == "key=value" );
+    REQUIRE( file.match( lit<"key=">() & lit<"value">() & eof() ).has_value() );
+#ifdef PEGLEX_HAS_MMAP
+    auto mapped = PaddedBuffer::map_file( path );
+    REQUIRE( mapped.view() == "key=value" );
+    REQUIRE( mapped.data()[mapped.size()+PaddedBuffer::padding-1] == '\0' );
+    REQUIRE( mapped.match( lit<"key=">() & lit<"value">() & eof() ).has_value() );
+
+    // moving a mapping leaves an empty buffer behind
+    PaddedBuffer moved( std::move( mapped ) );
+    REQUIRE( moved.view() == "key=value" );
+    REQUIRE( mapped.data() == nullptr );
+    REQUIRE( mapped.size() == 0 );
+#endif
+    std::remove( path );
+    REQUIRE_THROWS( PaddedBuffer::from_file( path ) );
+}
+
+TEST_CASE("SimdKernels_works","[Simd Tests]"){
+    using FindFn  = const char* (*)( const char*, const char*, std::string_view );
+    using EqualFn = bool (*)( const char*, const char*, size_t );
+    struct Variant { FindFn find_any; FindFn find_substring; EqualFn equal; bool supported; };
+    std::vector<Variant> variants{ { simd::scalar::find_any, simd::scalar::find_substring, simd::scalar::equal, true } };
+#ifdef PEGLEX_X86_DISPATCH
+    variants.push_back( { simd::sse2::find_any, simd::sse2::find_substring, simd::sse2::equal, true } );
+    variants.push_back( { simd::avx2::find_any, simd::avx2::find_substring, simd::avx2::equal, bool(__builtin_cpu_supports("avx2")) } );
+    variants.push_back( { simd::avx512::find_any, simd::avx512::find_substring, simd::avx512::equal, bool(__builtin_cpu_supports("avx512bw")) } );
+#endif
+
+    // hits at every offset across several vector widths, including the tails
+    std::string text( 200, 'a' );
+    for( const Variant& v : variants ){
+        if( !v.supported ){
+            continue;
+        }
+        for( size_t pos=0; pos<text.size(); ++pos ){
+            std::string t = text;
+            t[pos] = ',';
+            const char* b = t.data();
+            const char* e = b+t.size();
+            REQUIRE( v.find_any( b, e, ",;" ) == b+pos );
+            REQUIRE( v.find_any( b, b+pos, ",;" ) == b+pos );
+            REQUIRE( v.find_substring( b, e, "a,a" ) == ( pos && pos+1 < t.size() ? b+pos-1 : e ) );
+            REQUIRE( v.find_substring( b, e, "aaa,aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa" ) == ( pos >= 3 && pos+41 < t.size() ? b+pos-3 : e ) );
+            REQUIRE( !v.equal( b, text.data(), t.size() ) );
+            REQUIRE( v.equal( b, text.data(), pos ) );
+        }
+        REQUIRE( v.find_substring( text.data(), text.data()+text.size(), "" ) == text.data() );
+    }
+}
+
+TEST_CASE("UntilScan_works","[Simd Tests]"){
+    const char* src = "key: value; other";
+    REQUIRE( *until(';').match(src) == src+10 );
+    REQUIRE( *until("; ").match(src) == src+10 );
+    REQUIRE( *until( lit<"; o">() ).match(src) == src+10 );
+    REQUIRE( !until('#').match(src).has_value() );
+    REQUIRE( !until( lit<"#">() ).match(src).has_value() );
+    REQUIRE( !until('\0').match(src).has_value() );
+
+    // padded buffers stop at embedded terminators like the byte-wise scan
+    std::string text = std::string( 100, 'x' ) + "end";
+    text[50] = '\0';
+    PaddedBuffer buffer( text );
+    REQUIRE( !buffer.match( until('e') ).has_value() );
+    REQUIRE( !buffer.match( until( lit<"end">() ) ).has_value() );
+    REQUIRE( *buffer.match( until('x') ) == buffer.data() );
+
+    PaddedBuffer lines( std::string( 300, 'x' ) + "\nend" );
+    REQUIRE( *lines.match( until('\n') ) == lines.data()+300 );
+    REQUIRE( *lines.match( until( lit<"\nend">() ) ) == lines.data()+300 );
+    REQUIRE( !lines.match( until( lit<"ends">() ) ).has_value() );
+}
+
+TEST_CASE("StructuralIndex_works","[Simd Tests]"){
+    std::string text;
+    for( int i=0; i<50; ++i ){
+        text += "{\"k" + std::to_string(i) + "\": [" + std::to_string(i*i) + ", \"v\"]},\n";
+    }
+    PaddedBuffer buffer( text );
+    StructuralIndex index( buffer, "\"[]{},\n" );
+    REQUIRE( index.indexed(',') );
+    REQUIRE( !index.indexed(':') );
+    REQUIRE( !index.indexed('\0') );
+
+    // queries agree with scanning the bytes at every position
+    const char* data = buffer.data();
+    for( size_t pos=0; pos<=text.size(); ++pos ){
+        for( char c : std::string_view("\"[],\n") ){
+            size_t expect = text.find( c, pos );
+            REQUIRE( index.find( data+pos, c ) == data + ( expect == std::string::npos ? text.size() : expect ) );
+        }
+        REQUIRE( index.count( data, data+pos, '"' ) == size_t(std::count( text.begin(), text.begin()+pos, '"' )) );
+    }
+
+    // until() over indexed characters walks the bitmaps
+    auto line = until('\n') & '\n';
+    auto ret = index.match( plus( line ) & eof() );
+    REQUIRE( ret.has_value() );
+    REQUIRE( *ret == data+text.size() );
+    REQUIRE( !index.match( until(':') & until(';') ).has_value() );
+    REQUIRE( detail::structural_index == nullptr );
+
+    // characters outside the index are scanned for, direct queries for them throw
+    REQUIRE( **index.match( until(':') ) == ':' );
+    REQUIRE_THROWS( index.find( data, ':' ) );
+    REQUIRE_THROWS( index.count( data, data+text.size(), '\0' ) );
+
+    // the dispatched classifier agrees with the scalar one
+    const size_t blocks = (buffer.size()+64)/64;
+    std::vector<uint64_t> fast( blocks*3 ), slow( blocks*3 );
+    simd::classify( data, blocks, "\"\n,", fast.data() );
+    simd::scalar::classify( data, blocks, "\"\n,", slow.data() );
+    REQUIRE( fast == slow );
+
+    REQUIRE_THROWS( StructuralIndex( buffer, "0123456789abcdef" ) );
+}
+
+TEST_CASE("ClassScan_works","[Simd Tests]"){
+    // the lowered scans agree with matching one byte at a time
+    auto generic = []( auto expr, const char* src ) -> const char* {
+        while( *src && expr.match(src) ){
+            ++src;
+        }
+        return src;
+    };
+    std::string text = "abc123 \"quoted\" text\nsecond line\x80\xff tail";
+    for( size_t pos=0; pos<=text.size(); ++pos ){
+        const char* src = text.c_str()+pos;
+        REQUIRE( *star( alpha() ).match(src) == generic( alpha(), src ) );
+        REQUIRE( *star( digit() ).match(src) == generic( digit(), src ) );
+        REQUIRE( *star( Char('a') ).match(src) == generic( Char('a'), src ) );
+        REQUIRE( *star( range('\x80','\xff') ).match(src) == generic( range('\x80','\xff'), src ) );
+        REQUIRE( *star( !Char('"') & any() ).match(src) == generic( !Char('"'), src ) );
+        REQUIRE( *star( !newline() & any() ).match(src) == generic( !newline(), src ) );
+        REQUIRE( *star( !( Char('"') | '\\' | range('\x80','\xff') ) & any() ).match(src) == generic( !( Char('"') | '\\' | range('\x80','\xff') ), src ) );
+        REQUIRE( *star( !alphanum() & any() ).match(src) == generic( !alphanum(), src ) );
+
+        const char* stop = generic( !( Char('"') | newline() ), src );
+        auto found = until( Char('"') | newline() ).match(src);
+        REQUIRE( found == ( *stop ? std::optional<const char*>(stop) : std::nullopt ) );
+        REQUIRE( until( check( Char('"') | newline() ) ).match(src) == found );
+    }
+
+    // runs end at the terminator instead of looping on it
+    const char* line = "no newline";
+    REQUIRE( *star( !newline() & any() ).match(line) == line+10 );
+    REQUIRE( *star( range('\0','z') ).match(line) == line+10 );
+
+    // padded buffers take the kernels for small stop sets
+    PaddedBuffer buffer( text );
+    auto until_quote = star( !Char('"') & any() ) & '"';
+    REQUIRE( *buffer.match( until_quote ) == buffer.data()+8 );
+
+    // nodes with the same stop set share one scan and stay small enough to store inline
+    REQUIRE( star( alpha() )._scan == star( alpha() )._scan );
+    REQUIRE( star( !alpha() & any() )._scan == until( alpha() )._scan );
+    REQUIRE( sizeof( star( alpha() ) ) <= AnyRule::buffer_size );
+}
+
+TEST_CASE("OrFactoring_works","[Basic Tests]"){
+    auto decl = lit<"int">() & ' ' & plus( alpha() ) | lit<"int">() & '[' & digits() & ']';
+    REQUIRE( decl._shared == 1 );
+    REQUIRE( *decl.match("int x") == std::string_view("int x").end() );
+    REQUIRE( decl.match("int[4]").has_value() );
+    REQUIRE( !decl.match("int(").has_value() );
+    REQUIRE( !decl.match("long x").has_value() );
+
+    // grouping does not matter, and unequal values stop the prefix
+    auto grouped = Str("ab") & ( Char('c') & 'd' ) | ( Str("ab") & 'c' ) & 'e';
+    REQUIRE( grouped._shared == 2 );
+    REQUIRE( ( Str("ab") & 'c' | Str("ax") & 'c' )._shared == 0 );
+    REQUIRE( *grouped.match("abce") == std::string_view("abce").end() );
+
+    // nested composites compare element by element
+    auto nested = ( Char('a') | 'b' ) & star( !Char(';') & digit() ) & ';' | ( Char('a') | 'b' ) & star( !Char(';') & digit() ) & '!';
+    REQUIRE( nested._shared == 2 );
+    REQUIRE( nested.match("b12!").has_value() );
+
+    // callbacks on the alternatives fire as if each had been matched in full
+    std::vector<std::string> events;
+    auto delim   = check( whitespace() | eof() );
+    auto literal = cb( "0x" & plus( hex() & hex() ) & delim, [&]( const std::string& s ){ events.push_back( "hex " + s ); } )
+                 | cb( real() & delim, [&]( const std::string& s ){ events.push_back( "real " + s ); }, [&]{ events.push_back( "no real" ); } )
+                 | cb( integer() & delim, [&]( const std::string& s ){ events.push_back( "int " + s ); }, [&]{ events.push_back( "no int" ); } );
+    REQUIRE( literal._shared == 3 );
+    REQUIRE( literal.match("-12.5").has_value() );
+    REQUIRE( literal.match("42 ").has_value() );
+    REQUIRE( !literal.match("x").has_value() );
+    REQUIRE( literal.match("0xff").has_value() );
+    REQUIRE( events == std::vector<std::string>{ "real -12.5", "no real", "int 42", "no real", "no int", "hex 0xff" } );
+}
+
+TEST_CASE("PeekThen_works","[Basic Tests]"){
+    // stateless lookaheads followed by the same expression are fused
+    auto word = plus( alpha() );
+    auto fused = check( word ) & word;
+    REQUIRE( fused._fused );
+    REQUIRE( *fused.match("abc1") == std::string_view("abc1").data()+3 );
+    REQUIRE( !fused.match("1abc").has_value() );
+    REQUIRE( !( check( Str("ab") ) & Str("ac") )._fused );
+    REQUIRE( !( check( Str("ab") ) & Str("ac") ).match("ab").has_value() );
+
+    auto keyed = lit<"key">() & check( Char('=') ) & '=';
+    REQUIRE( keyed._fused );
+    REQUIRE( *keyed.match("key=1") == std::string_view("key=1").data()+4 );
+    REQUIRE( !keyed.match("key:1").has_value() );
+
+    // callbacks run twice unless peek_then asks for fusion
+    int count = 0;
+    auto counted = cb( word, [&]{ ++count; } );
+    REQUIRE( !( check( counted ) & counted )._fused );
+    REQUIRE( ( check( counted ) & counted ).match("abc").has_value() );
+    REQUIRE( count == 2 );
+    REQUIRE( peek_then( counted ).match("abc").has_value() );
+    REQUIRE( count == 3 );
+    REQUIRE( !peek_then( counted ).match("123").has_value() );
+}
+
+TEST_CASE("Session_works","[Allocator Tests]"){
+    // the grammar is built once against the session and reused for every message
+    Session<4> session( 256 );
+    std::vector<std::pmr::string> names;
+    auto& tags = session.symbols();
+    auto name = plus( alpha() );
+    auto tag  = '<' & push_capture( tags, cb( name, session.resource(), [&]( const std::pmr::string& s ){ names.push_back( s ); } ) ) & '>';
+    auto element = plus( tag ) & plus( "</" & match_top( tags ) & '>' & pop( tags ) );
+
+    size_t capacity = 0;
+    for( int i=0; i<100; ++i ){
+        session.reset();
+        names.clear();
+        REQUIRE( tags.empty() );
+        REQUIRE( element.match("<a><bb><ccc><dddd><eeeee></eeeee></dddd></ccc></bb></a>").has_value() );
+        REQUIRE( tags.empty() );
+        REQUIRE( names.size() == 5 );
+        REQUIRE( names[4] == "eeeee" );
+        if( i == 0 ){
+            capacity = session.arena().capacity();
+        }
+        REQUIRE( session.arena().capacity() == capacity );
+    }
+    names.clear();
+
+    // arena allocations honour alignment and grow past the block size
+    Arena arena( 64 );
+    void* small = arena.allocate( 3, 1 );
+    void* wide  = arena.allocate( 32, 32 );
+    void* large = arena.allocate( 1000, 8 );
+    REQUIRE( reinterpret_cast<uintptr_t>(wide) % 32 == 0 );
+    REQUIRE( small != wide );
+    REQUIRE( large != nullptr );
+    const size_t held = arena.capacity();
+    arena.reset();
+    REQUIRE( arena.allocate( 3, 1 ) == small );
+    REQUIRE( arena.capacity() == held );
+
+    // leases return sessions to the thread-local pool
+    Session<>* first = nullptr;
+    {
+        auto lease = Session<>::acquire();
+        first = lease.get();
+        lease->symbols().push("x");
+    }
+    auto again = Session<>::acquire();
+    REQUIRE( again.get() == first );
+    REQUIRE( again->symbols().empty() );
+    auto other = Session<>::acquire();
+    REQUIRE( other.get() != first );
+}
+
+namespace {
+    // as it would be declared in a header and defined in its own translation unit
+    AnyRule number_rule(){
+        return maybe( pm() ) & digits() & maybe( '.' & digits() );
+    }
+}
+
+TEST_CASE("AnyRule_works","[Basic Tests]"){
+    AnyRule number = number_rule();
+    REQUIRE( *number.match("-12.5x") == std::string_view("-12.5x").data()+5 );
+    REQUIRE( !number.match("x").has_value() );
+    REQUIRE( !AnyRule().match("").has_value() );
+    REQUIRE( AnyRule().empty() );
+
+    // rules compose like any other node and can be kept in containers
+    auto list = number & star( ',' & number );
+    REQUIRE( *list.match("1,2.5,-3") == std::string_view("1,2.5,-3").end() );
+
+    int calls = 0;
+    auto large = cb( real() & check( whitespace() | eof() ), [&]( const std::string& ){ ++calls; } );
+    static_assert( sizeof(large) > AnyRule::buffer_size );
+    std::vector<AnyRule> rules{ lit<"GET">(), large, number };
+    rules.push_back( rules[1] );
+    rules[0] = rules[2];
+    REQUIRE( rules[0].match("42").has_value() );
+    REQUIRE( rules[1].match("1.5").has_value() );
+    REQUIRE( rules[3].match("2.5 ").has_value() );
+    REQUIRE( calls == 2 );
+    std::vector<AnyRule> copies = rules;
+    rules.clear();
+    REQUIRE( copies[3].match("3.").has_value() );
+    REQUIRE( calls == 3 );
+
+    // moves never throw, and move assignment takes over inline and heap-stored rules alike
+    static_assert( std::is_nothrow_move_constructible_v<AnyRule> && std::is_nothrow_move_assignable_v<AnyRule> );
+    AnyRule moved;
+    moved = std::move( copies[0] );
+    REQUIRE( moved.match("42").has_value() );
+    moved = std::move( copies[1] );
+    REQUIRE( copies[1].empty() );
+    REQUIRE( moved.match("4.5").has_value() );
+    REQUIRE( calls == 4 );
+}
+
+TEST_CASE("GrammarHandle_works","[Basic Tests]"){
+    GrammarHandle<> handle( AnyRule( lit<"v1">() ) );
+    {
+        auto reader = handle.reader();
+        auto guard = reader.read();
+        handle.publish( AnyRule( lit<"v2">() ) );
+
+        // the pinned version stays alive and readable until the guard goes
+        REQUIRE( guard.match("v1").has_value() );
+        REQUIRE( reader.match("v2").has_value() );
+        REQUIRE( handle.collect() == 1 );
+    }
+    REQUIRE( handle.collect() == 0 );
+
+    // readers keep matching while versions are swapped underneath them
+    std::atomic<bool> stop = false;
+    std::atomic<int>  failures = 0;
+    std::vector<std::thread> threads;
+    for( int t=0; t<4; ++t ){
+        threads.emplace_back( [&]{
+            auto reader = handle.reader();
+            while( !stop ){
+                auto guard = reader.read();
+                if( !guard.match("v1").has_value() && !guard.match("v2").has_value() ){
+                    ++failures;
+                }
+            }
+        } );
+    }
+    for( int i=0; i<1000; ++i ){
+        handle.publish( i%2 ? AnyRule( lit<"v1">() ) : AnyRule( lit<"v2">() ) );
+    }
+    stop = true;
+    for( auto& t : threads ){
+        t.join();
+    }
+    REQUIRE( failures == 0 );
+    REQUIRE( handle.collect() == 0 );
+}
+
+TEST_CASE("Nfa_works","[Basic Tests]"){
+    auto at = []( const char* s, size_t n ){ return s+n; };
+
+    // plain sequences run as shift-and
+    auto date = nfa( R"(\d{4}-\d\d-\d\d)" );
+    REQUIRE( date.shift_and() );
+    REQUIRE( date.positions() == 10 );
+    const char* d = "2024-03-17T";
+    REQUIRE( *date.match(d) == at(d,10) );
+    REQUIRE( !date.match("2024-3-17").has_value() );
+    REQUIRE( !date.match("2024-03-1").has_value() );
+
+    // alternation and repetition use the follow tables, the longest match wins
+    auto kw = nfa( "if|in|int|interface" );
+    REQUIRE( !kw.shift_and() );
+    const char* k = "interfaces";
+    REQUIRE( *kw.match(k) == at(k,9) );
+    REQUIRE( *kw.match("inx") == std::string_view("inx").data()+2 );
+    REQUIRE( !kw.match("i").has_value() );
+
+    // unlike star("ab") & "ab" this backtracks like a regex
+    auto ab = nfa( "(ab)*ab" );
+    const char* s = "ababab!";
+    REQUIRE( *ab.match(s) == at(s,6) );
+
+    auto id = nfa( R"([A-Za-z_]\w{0,7}(\.[a-z]+)?)" );
+    const char* i = "user_name12.field rest";
+    REQUIRE( *id.match(i) == at(i,8) );
+    const char* j = "abc.def rest";
+    REQUIRE( *id.match(j) == at(j,7) );
+    REQUIRE( !id.match("9abc").has_value() );
+
+    auto hex = nfa( R"(0x[0-9a-fA-F]{2,}|[^\x00-\x2f]?)" );
+    REQUIRE( *hex.match("0xfFz") == std::string_view("0xfFz").data()+4 );
+    REQUIRE( *hex.match("0xf") == std::string_view("0xf").data()+1 );
+    REQUIRE( *hex.match("") == std::string_view("").data() );
+
+    // bounded repeats copy the quantifiers already applied to the atom
+    const char* e = "";
+    REQUIRE( *nfa( "a*{2}" ).match(e) == e );
+    REQUIRE( *nfa( "a?{2}" ).match(e) == e );
+    REQUIRE( *nfa( "(ab)*{2}" ).match(e) == e );
+    REQUIRE( *nfa( "(ab)*{2}" ).match("ababx") == std::string_view("ababx").data()+4 );
+    REQUIRE( *nfa( "a?{2}" ).match("aaa") == std::string_view("aaa").data()+2 );
+    REQUIRE( *nfa( "a+{2}b" ).match("aaab") == std::string_view("aaab").data()+4 );
+    REQUIRE( !nfa( "a+{2}b" ).match("ab").has_value() );
+    REQUIRE( nfa( "a?{3}" ).positions() == 3 );
+
+    // composes with the rest of the library and stops at the terminator
+    auto pair = nfa( "[a-z]+" ) & '=' & nfa( R"(\d+(\.\d*)?)" ) & eof();
+    REQUIRE( pair.match("x=1.5").has_value() );
+    REQUIRE( !pair.match("x=.5").has_value() );
+    REQUIRE( !nfa( ".+" ).match("").has_value() );
+
+    REQUIRE_THROWS( nfa( "(ab" ) );
+    REQUIRE_THROWS( nfa( "ab)" ) );
+    REQUIRE_THROWS( nfa( "*a" ) );
+    REQUIRE_THROWS( nfa( "a{3,2}" ) );
+    REQUIRE_THROWS( nfa( "[ab" ) );
+    REQUIRE_THROWS( nfa( "a{65}" ) );
+    REQUIRE( nfa( "a{64}" ).positions() == 64 );
+}
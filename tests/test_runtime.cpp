@@ -0,0 +1,305 @@
+#include <peglex/runtime.h>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace peglex;
+
+namespace {
+    const char* list_grammar = R"(
+        # comma separated numbers and names
+        list   <- item (',' ws item)* !.
+        item   <- number / name
+        number <- '-'? [0-9]+ ('.' [0-9]+)?
+        name   <- [a-zA-Z_] [a-zA-Z0-9_]*
+        ws     <- [ \t]*
+    )";
+}
+
+TEST_CASE("RuntimeGrammar_works","[Runtime Tests]"){
+    auto grammar = runtime::Grammar::compile( list_grammar );
+    REQUIRE( grammar.rules().size() == 5 );
+    REQUIRE( grammar.name(0) == "list" );
+    REQUIRE( grammar.find("ws") == 4u );
+    REQUIRE( grammar.match("1, -2.5,\tfoo_1").has_value() );
+    REQUIRE( !grammar.match("1,,2").has_value() );
+    REQUIRE( !grammar.match("1.").has_value() );
+
+    // rules are ordinary patterns
+    auto number = grammar.rule("number");
+    auto pair   = '(' & number & ',' & number & ')';
+    REQUIRE( *pair.match("(1,-2)x") == std::string_view("(1,-2)x").data()+6 );
+    AnyRule erased = grammar.rule("name");
+    REQUIRE( *erased.match("abc def") == std::string_view("abc def").data()+3 );
+
+    // adjacent single-byte alternatives fold into one set and repeated sets into a span
+    auto folded = runtime::Grammar::compile( "digit <- '0' / [1-8] / '9'\nrun <- ('a' / 'b')+" );
+    REQUIRE( folded.nodes()[folded.rules()[0].node].op == runtime::Op::Set );
+    REQUIRE( folded.nodes()[folded.rules()[1].node].op == runtime::Op::Span );
+    REQUIRE( folded.sets().size() == 2 );
+    REQUIRE( *folded.match("abba!", 1) == std::string_view("abba!").data()+4 );
+    REQUIRE( !folded.match("!", 1).has_value() );
+
+    // classes, escapes and predicates
+    auto misc = runtime::Grammar::compile( R"(s <- &'a' [^\x62-z] "\"\n" !'x' .)" );
+    REQUIRE( misc.match("a\"\ny").has_value() );
+    REQUIRE( !misc.match("a\"\nx").has_value() );
+    REQUIRE( !misc.match("b\"\ny").has_value() );
+
+    REQUIRE_THROWS( runtime::Grammar::compile( "" ) );
+    REQUIRE_THROWS( runtime::Grammar::compile( "a <- b" ) );
+    REQUIRE_THROWS( runtime::Grammar::compile( "a <- 'x" ) );
+    REQUIRE_THROWS( runtime::Grammar::compile( "a <- 'x'\na <- 'y'" ) );
+    REQUIRE_THROWS( runtime::Grammar::compile( "a <- ('x'" ) );
+    REQUIRE_THROWS( grammar.rule("missing") );
+
+    // images are relocatable and validated when loaded
+    auto copy = runtime::Grammar::load( PaddedBuffer( grammar.image() ) );
+    REQUIRE( copy.match("a,b").has_value() );
+    REQUIRE_THROWS( runtime::Grammar::load( PaddedBuffer( grammar.image().substr( 0, grammar.image().size()-1 ) ) ) );
+    std::string damaged( grammar.image() );
+    reinterpret_cast<runtime::detail::Header*>( damaged.data() )->num_nodes += 1000;
+    REQUIRE_THROWS( runtime::Grammar::load( PaddedBuffer( damaged ) ) );
+
+    // a node referring to itself or a later node could loop, such images are rejected too
+    std::string cyclic( grammar.image() );
+    const auto* header = reinterpret_cast<const runtime::detail::Header*>( cyclic.data() );
+    auto* nodes = reinterpret_cast<runtime::Node*>( cyclic.data()+header->nodes );
+    uint32_t unary = 0;
+    while( unary < header->num_nodes && nodes[unary].op != runtime::Op::Star && nodes[unary].op != runtime::Op::Plus ){
+        ++unary;
+    }
+    REQUIRE( unary < header->num_nodes );
+    nodes[unary].a = unary;
+    REQUIRE_THROWS( runtime::Grammar::load( PaddedBuffer( cyclic ) ) );
+}
+
+TEST_CASE("GrammarCache_works","[Runtime Tests]"){
+    const auto dir = std::filesystem::temp_directory_path() / ("peglex_cache_" + std::to_string( std::random_device{}() ));
+    {
+        runtime::GrammarCache cache( dir );
+        auto cold = cache.get( list_grammar );
+        REQUIRE( cache.misses() == 1 );
+        REQUIRE( std::filesystem::exists( cache.path( list_grammar ) ) );
+
+        auto warm = cache.get( list_grammar );
+        REQUIRE( cache.hits() == 1 );
+        REQUIRE( warm.image() == cold.image() );
+        REQUIRE( warm.match("x, 1").has_value() );
+
+        // a damaged entry is recompiled and replaced
+        std::ofstream( cache.path( list_grammar ), std::ios::binary | std::ios::trunc ) << "garbage";
+        REQUIRE( cache.get( list_grammar ).match("y").has_value() );
+        REQUIRE( cache.misses() == 2 );
+        REQUIRE( cache.get( list_grammar ).match("z").has_value() );
+        REQUIRE( cache.hits() == 2 );
+
+        REQUIRE( cache.path( "a <- 'a'" ) != cache.path( list_grammar ) );
+    }
+    {
+        // a cache that cannot be written to still returns grammars, every lookup is a miss
+        std::ofstream( dir / "file" ) << "not a directory";
+        runtime::GrammarCache cache( dir / "file" );
+        REQUIRE( cache.get( list_grammar ).match("x").has_value() );
+        REQUIRE( cache.get( list_grammar ).match("y").has_value() );
+        REQUIRE( cache.misses() == 2 );
+        REQUIRE( cache.hits() == 0 );
+    }
+    std::filesystem::remove_all( dir );
+}
+
+#ifdef PEGLEX_HAS_DLOPEN
+TEST_CASE("GrammarPlugin_works","[Runtime Tests]"){
+    // the compiler is not run through a shell, so quotes and spaces in paths are harmless
+    const auto dir = std::filesystem::temp_directory_path() / ("peglex plugin's $dir_" + std::to_string( std::random_device{}() ));
+    {
+        auto grammar = runtime::Grammar::compile( list_grammar );
+        REQUIRE( runtime::generate( grammar ).find( PEGLEX_PLUGIN_SYMBOL ) != std::string::npos );
+
+        auto plugin = runtime::Plugin::build( grammar, dir, std::string( PEGLEX_TEST_CXX ) + " -O1" );
+        REQUIRE( plugin.key() == grammar.key() );
+        REQUIRE( plugin.source() == grammar.source() );
+        // only the installed library and its source are left behind
+        std::vector<std::string> files;
+        for( const auto& entry : std::filesystem::directory_iterator( dir ) ){
+            files.push_back( entry.path().extension().string() );
+        }
+        std::sort( files.begin(), files.end() );
+        REQUIRE( files == std::vector<std::string>{ ".cpp", ".so" } );
+        REQUIRE( plugin.size() == 5 );
+        REQUIRE( plugin.name(2) == "number" );
+
+        // the compiled plugin agrees with the interpreter
+        for( const char* s : { "1, -2.5,\tfoo_1", "1,,2", "1.", "", "x", "a,b,c", "-", "12.5e", "\xff" } ){
+            REQUIRE( plugin.match( s ) == grammar.match( s ) );
+            for( uint32_t rule=1; rule<5; ++rule ){
+                REQUIRE( plugin.match( s, nullptr, rule ) == grammar.match( s, rule ) );
+            }
+        }
+
+        // an explicit end bounds the input
+        const char* text = "1,2x";
+        REQUIRE( *plugin.match( text, text+3 ) == text+3 );
+        REQUIRE( !plugin.match( text ).has_value() );
+
+        auto number = plugin.rule("number");
+        auto pair   = '(' & number & ',' & number & ')';
+        REQUIRE( pair.match("(1,-2)").has_value() );
+
+        // an existing library for the same grammar is reused without compiling
+        auto again = runtime::Plugin::build( grammar, dir, "false" );
+        REQUIRE( again.match("1,2").has_value() );
+        REQUIRE_THROWS( runtime::Plugin::build( runtime::Grammar::compile( "a <- 'a'" ), dir, "false" ) );
+    }
+    std::filesystem::remove_all( dir );
+}
+#endif
+
+namespace {
+    int native_calls = 0;
+
+    // hand-written stand-ins for compiled rules
+    const char* native_digits( const char* p, const char*, void* ){
+        ++native_calls;
+        const char* start = p;
+        while( *p >= '0' && *p <= '9' ){
+            ++p;
+        }
+        return p != start ? p : nullptr;
+    }
+
+    const char* broken_digits( const char* p, const char*, void* ){
+        ++native_calls;
+        return p+1;
+    }
+
+    // stands in for code that is unmapped once its grammar was deoptimized
+    std::atomic<bool> unloaded = false;
+    std::atomic<int>  late_calls = 0;
+
+    const char* slow_digits( const char* p, const char*, void* ){
+        std::this_thread::sleep_for( std::chrono::microseconds(50) );
+        late_calls += unloaded.load();
+        while( *p >= '0' && *p <= '9' ){
+            ++p;
+        }
+        return p;
+    }
+}
+
+TEST_CASE("TieredGrammar_works","[Runtime Tests]"){
+    auto grammar = runtime::Grammar::compile( "list <- digits (',' digits)* !.\ndigits <- [0-9]+" );
+    using Tier = runtime::TieredGrammar::Tier;
+
+    // digits gets hot through references from list and is then called natively, also from the interpreter
+    native_calls = 0;
+    std::vector<uint32_t> compiled;
+    runtime::TieredGrammar tiered( grammar, [&]( const runtime::Grammar&, uint32_t rule ) -> peglex_match_fn {
+        compiled.push_back( rule );
+        return rule == 1 ? native_digits : nullptr;
+    }, 4, 2 );
+    auto list = tiered.rule("list");
+    REQUIRE( list.match("1,22").has_value() );
+    REQUIRE( tiered.tier(1) == Tier::Interpreted );
+
+    // compilation runs in the background, the rule stays interpreted until it is done
+    REQUIRE( list.match("3,4,5").has_value() );
+    REQUIRE( tiered.tier(1) != Tier::Interpreted );
+    tiered.wait();
+    REQUIRE( tiered.tier(1) == Tier::Native );
+    REQUIRE( compiled == std::vector<uint32_t>{ 1 } );
+    for( int i=0; i<4; ++i ){
+        REQUIRE( list.match("6,78,9").has_value() );
+        REQUIRE( !list.match("6,,9").has_value() );
+    }
+    REQUIRE( native_calls > 0 );
+    REQUIRE( tiered.tier(1) == Tier::Native );
+
+    // native and compiling rules are no longer counted
+    REQUIRE( tiered.calls(1) == 4 );
+    tiered.wait();
+
+    // list gets hot too, but a null entry point keeps it interpreted
+    REQUIRE( tiered.tier(0) == Tier::Deoptimized );
+    REQUIRE( compiled == std::vector<uint32_t>{ 1, 0 } );
+
+    tiered.deoptimize(1);
+    native_calls = 0;
+    REQUIRE( list.match("1,2").has_value() );
+    REQUIRE( native_calls == 0 );
+    REQUIRE( tiered.tier(1) == Tier::Deoptimized );
+
+    // native code that disagrees with the interpreter is caught while verifying and dropped
+    runtime::TieredGrammar checked( grammar, []( const runtime::Grammar&, uint32_t ){ return broken_digits; }, 1, 16 );
+    REQUIRE( checked.match("1,2").has_value() );
+    checked.wait();
+    for( int i=0; i<4; ++i ){
+        REQUIRE( checked.match("1,2").has_value() );
+        REQUIRE( !checked.match("1,x").has_value() );
+    }
+    REQUIRE( checked.tier(1) == Tier::Deoptimized );
+    REQUIRE( checked.tier(0) == Tier::Deoptimized );
+
+    // a throwing compiler leaves rules interpreted
+    runtime::TieredGrammar failing( grammar, []( const runtime::Grammar&, uint32_t ) -> peglex_match_fn { throw std::runtime_error("no compiler"); }, 1 );
+    REQUIRE( failing.match("12").has_value() );
+    failing.wait();
+    REQUIRE( failing.match("12").has_value() );
+    REQUIRE( failing.tier(0) == Tier::Deoptimized );
+
+    // deoptimize() returns only once no thread runs the native code anymore
+    runtime::TieredGrammar busy( grammar, []( const runtime::Grammar&, uint32_t rule ) -> peglex_match_fn {
+        return rule == 1 ? slow_digits : nullptr;
+    }, 1, 0 );
+    REQUIRE( busy.match("1,2").has_value() );
+    busy.wait();
+    REQUIRE( busy.tier(1) == Tier::Native );
+    std::atomic<bool> stop = false;
+    std::vector<std::thread> threads;
+    for( int t=0; t<4; ++t ){
+        threads.emplace_back( [&]{
+            while( !stop ){
+                busy.match("12,34");
+            }
+        } );
+    }
+    std::this_thread::sleep_for( std::chrono::milliseconds(5) );
+    busy.deoptimize(1);
+    unloaded = true;
+    std::this_thread::sleep_for( std::chrono::milliseconds(5) );
+    stop = true;
+    for( auto& thread : threads ){
+        thread.join();
+    }
+    REQUIRE( late_calls == 0 );
+}
+
+#ifdef PEGLEX_HAS_DLOPEN
+TEST_CASE("TieredPlugin_works","[Runtime Tests]"){
+    const auto dir = std::filesystem::temp_directory_path() / ("peglex_tiered_" + std::to_string( std::random_device{}() ));
+    {
+        runtime::TieredGrammar tiered( runtime::Grammar::compile( list_grammar ), runtime::plugin_compiler( dir, std::string( PEGLEX_TEST_CXX ) + " -O1" ), 8 );
+        for( int i=0; i<20; ++i ){
+            REQUIRE( tiered.match("1, -2.5,\tfoo_1").has_value() );
+            REQUIRE( !tiered.match("1,,2").has_value() );
+        }
+        tiered.wait();
+        for( int i=0; i<20; ++i ){
+            REQUIRE( tiered.match("1, -2.5,\tfoo_1").has_value() );
+            REQUIRE( !tiered.match("1,,2").has_value() );
+        }
+        REQUIRE( tiered.tier(0) == runtime::TieredGrammar::Tier::Native );
+        REQUIRE( tiered.tier(1) == runtime::TieredGrammar::Tier::Native );
+    }
+    std::filesystem::remove_all( dir );
+}
+#endif